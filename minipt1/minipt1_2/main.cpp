@@ -259,28 +259,132 @@ private:
 };
 
 
+// Boost-style hash combining used by the state hashes below.
+inline size_t hash_combine(size_t seed, size_t value) {
+    return seed ^ (value + 0x9e3779b97f4a7c15ULL + (seed << 6) + (seed >> 2));
+}
+
+inline size_t hash_value(Position p) {
+    return hash_combine(std::hash<size_t>{}(p.row), std::hash<size_t>{}(p.col));
+}
+
+// Calls `hash_value(state)` found by ADL, so every problem only has to
+// provide that function next to its State.
+struct StateHasher {
+    template<typename T>
+    size_t operator()(const T &t) const { return hash_value(t); }
+};
+
+
+// Insert-only open-addressing hash map with linear probing. All entries live
+// in one contiguous array, so a lookup touches one or two cache lines instead
+// of a chain of heap nodes. Keys and values must be default constructible.
+template<typename Key, typename Value, typename Hash>
+class FlatHashMap {
+public:
+    explicit FlatHashMap(size_t capacity = 16) { rehash(capacity); }
+
+    size_t size() const { return _size; }
+
+    void reserve(size_t count) {
+        if (count * 8 > _entries.size() * 7) rehash(count * 8 / 7 + 1);
+    }
+
+    // Returns the value stored under `key` and whether it was inserted now.
+    // Only an insertion can grow the table, so hits never move entries around.
+    template<typename... Args>
+    std::pair<Value *, bool> try_emplace(const Key &key, Args &&... args) {
+        size_t i = slot_for(key);
+        if (_used[i]) return {&_entries[i].second, false};
+        if ((_size + 1) * 8 > _entries.size() * 7) {
+            reserve(_size + 1);
+            i = slot_for(key);
+        }
+        _used[i] = true;
+        _entries[i] = {key, Value(std::forward<Args>(args)...)};
+        _size++;
+        return {&_entries[i].second, true};
+    }
+
+    Value &operator[](const Key &key) { return *try_emplace(key).first; }
+
+    Value *find(const Key &key) {
+        size_t i = slot_for(key);
+        return _used[i] ? &_entries[i].second : nullptr;
+    }
+
+    const Value *find(const Key &key) const {
+        size_t i = slot_for(key);
+        return _used[i] ? &_entries[i].second : nullptr;
+    }
+
+    bool contains(const Key &key) const { return find(key) != nullptr; }
+
+private:
+    std::vector<std::pair<Key, Value> > _entries;
+    std::vector<uint8_t> _used;
+    size_t _size = 0;
+    size_t _shift = 64;
+    Hash _hash;
+
+    // Fibonacci hashing spreads weak hashes over the power-of-two table.
+    size_t home(const Key &key) const {
+        return (uint64_t(_hash(key)) * 0x9e3779b97f4a7c15ULL) >> _shift;
+    }
+
+    // Slot holding `key`, or the empty slot where it would be inserted.
+    size_t slot_for(const Key &key) const {
+        size_t mask = _entries.size() - 1;
+        for (size_t i = home(key);; i = (i + 1) & mask) {
+            if (!_used[i] || _entries[i].first == key) return i;
+        }
+    }
+
+    void rehash(size_t capacity) {
+        size_t bits = 1;
+        while ((size_t(1) << bits) < capacity) bits++;
+
+        auto entries = std::move(_entries);
+        auto used = std::move(_used);
+        _entries.assign(size_t(1) << bits, {});
+        _used.assign(size_t(1) << bits, false);
+        _shift = 64 - bits;
+
+        for (size_t i = 0; i < used.size(); i++) {
+            if (!used[i]) continue;
+            size_t j = slot_for(entries[i].first);
+            _used[j] = true;
+            _entries[j] = std::move(entries[i]);
+        }
+    }
+};
+
+
 // Implementation of BFS to solve state space search kind of problems.
 // Because the state space is usually much bigger than length of the
 // solution, we should not allocate P and D as vectors but we should
-// use std::set instead.
+// use a hash table instead. The table type is a template parameter;
+// the default flat table needs `hash_value(State)` and `State == State`.
 //
 // We are not interested in vertices from initial state to target one
 // but in actions that created this path. The return type is an optional
 // to distinguish "no solution exists" (return empty optional) and
 // "initial state is a solution" (return optional with empty vector)
 // cases.
-template<typename SearchProblem>
+template<typename SearchProblem,
+    typename Parents = FlatHashMap<typename SearchProblem::State,
+        std::pair<typename SearchProblem::State, typename SearchProblem::Action>, StateHasher> >
 std::optional<std::vector<typename SearchProblem::Action> > solve(const SearchProblem &G) {
     using Vertex = typename SearchProblem::State;
     using Action = typename SearchProblem::Action;
 
-    std::set<Vertex> visited;
+    // Every visited vertex has an entry, the start one points to itself.
+    Parents p;
     std::queue<Vertex> q;
-    std::map<Vertex, std::pair<Vertex, Action> > p;
 
     Vertex start = G.initial_state();
     q.push(start);
-    visited.insert(start);
+    p.try_emplace(start, start, Action{});
 
     if (G.is_target(start)) return std::vector<Action>();
 
@@ -290,17 +394,15 @@ std::optional<std::vector<typename SearchProblem::Action> > solve(const SearchPr
 
         for (Action &action: G.possible_actions(current)) {
             Vertex next = G.next_state(current, action);
-            if (visited.find(next) != visited.end()) continue;
-            visited.insert(next);
-            p[next] = {current, action};
+            if (!p.try_emplace(next, current, action).second) continue;
             if (G.is_target(next)) {
                 std::vector<Action> path;
                 Vertex vIt = next;
                 while (vIt != start) {
                     auto parent = p.find(vIt);
-                    if (parent == p.end()) break;
-                    path.push_back(parent->second.second);
-                    vIt = parent->second.first;
+                    if (!parent) break;
+                    path.push_back(parent->second);
+                    vIt = parent->first;
                 }
                 std::reverse(path.begin(), path.end());
                 return path;
@@ -341,6 +443,9 @@ struct SuperstitiousHero {
         }
         auto operator ==(const State &a) const { return !(*this < a) && !(a < *this); };
         auto operator !=(const State &a) const { return !(*this == a);};
+        friend size_t hash_value(const State &s) {
+            return hash_combine(hash_value(s.position), s.movesDoneMod5);
+        }
     };
 
     using Action = Direction;
@@ -406,6 +511,9 @@ struct LimpingKnight {
         unsigned int cooldown;
         State(Position currentPosition, unsigned int cooldown) : currentPosition(currentPosition), cooldown(cooldown){}
         friend auto operator <=>(const State &, const State &) = default;
+        friend size_t hash_value(const State &s) {
+            return hash_combine(hash_value(s.currentPosition), s.cooldown);
+        }
     };
 
     using Action = LimpingKnightAction;
@@ -503,6 +611,11 @@ struct BottleProblem {
         auto operator <(const State &s) const { return volume < s.volume; };
         auto operator ==(const State &s) const { return volume == s.volume; };
         auto operator !=(const State &s) const { return volume != s.volume; };
+        friend size_t hash_value(const State &s) {
+            size_t h = s.volume.size();
+            for (auto v: s.volume) h = hash_combine(h, v);
+            return h;
+        }
     };
 
     using Action = BottleOp;
@@ -12,7 +12,6 @@
 #include <list>
 #include <array>
 #include <vector>
-#include <deque>
 #include <unordered_set>
 #include <unordered_map>
 #include <set>
@@ -25,6 +24,19 @@
 #include <ranges>
 #include <optional>
 #include <variant>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <span>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <filesystem>
 
 struct Item {
   enum Type : uint8_t {
@@ -75,22 +87,44 @@ using Action = std::variant<Move, Pickup, Drop>;
 namespace student_namespace {
 #endif
 
+  // Do `turns` hits of dmg, dmg + step, dmg + 2 * step, ... deal at least `hp` damage?
+  // Callers guarantee every one of these hits is positive and `turns * dmg < 2^62`.
+  static bool series_reaches(int64_t hp, int64_t dmg, int64_t step, int64_t turns) {
+    int64_t pairs = turns * (turns - 1) / 2;
+    if (step < 0) return turns * dmg + step * pairs >= hp; // step * pairs never exceeds turns * dmg
+    int64_t rest = hp - turns * dmg;
+    return rest <= 0 || pairs >= (rest + step - 1) / step;
+  }
+
+  // Turns needed to deal `hp` damage when the damage changes by `stacking_dmg` every turn
+  // (turns with non-positive damage deal nothing). Solves the arithmetic series inequality
+  // by binary search on the number of damaging turns, all in 64-bit arithmetic.
   std::optional<int> turns_to_kill(int hp, int dmg, int stacking_dmg) {
     assert(hp > 0);
 
     if (stacking_dmg == 0) {
       if (dmg <= 0) return {};
-      return (hp + dmg - 1) / dmg;
+      return (hp - 1) / dmg + 1;
     }
 
-    int i = 0;
-    for (; hp > 0; i++) {
-      if (dmg <= 0 && stacking_dmg < 0) return {};
-      hp -= std::max(dmg, 0);
-      dmg += stacking_dmg;
+    int64_t idle = 0, first = dmg, step = stacking_dmg, limit = hp;
+    if (step < 0) {
+      if (first <= 0) return {};
+      limit = (first - step - 1) / -step; // Hits before the damage drops to zero
+      if (!series_reaches(hp, first, step, limit)) return {};
+    } else if (first <= 0) {
+      idle = (step - first) / step; // Turns until the damage becomes positive
+      first += idle * step;
     }
+    if (first >= hp) return int(std::min<int64_t>(idle + 1, std::numeric_limits<int>::max()));
 
-    return i;
+    int64_t lo = 1, hi = limit;
+    while (lo < hi) {
+      int64_t mid = lo + (hi - lo) / 2;
+      if (series_reaches(hp, first, step, mid)) hi = mid;
+      else lo = mid + 1;
+    }
+    return int(std::min<int64_t>(idle + lo, std::numeric_limits<int>::max()));
   }
 
   enum CombatResult {
@@ -117,11 +151,14 @@ namespace student_namespace {
     int stacking_off, stacking_def;
     bool first_attack, stealth;
 
-    bool operator==(const EquippedItem &o) const {
-      return type == o.type &&
-             hp == o.hp && off == o.off && def == o.def &&
-             stacking_off == o.stacking_off && stacking_def == o.stacking_def &&
-             first_attack == o.first_attack && stealth == o.stealth;
+    friend auto operator <=>(const EquippedItem &, const EquippedItem &) = default;
+
+    // At least as good in every stat with the same flags. Combat only gets easier with
+    // higher stats, while first_attack and stealth change the rules, so they must match.
+    bool dominates(const EquippedItem &o) const {
+      return type == o.type && first_attack == o.first_attack && stealth == o.stealth &&
+             hp >= o.hp && off >= o.off && def >= o.def &&
+             stacking_off >= o.stacking_off && stacking_def >= o.stacking_def;
     }
 
     static EquippedItem fromItem(const Item &i) {
@@ -138,263 +175,2108 @@ namespace student_namespace {
     }
   };
 
+  // -------------------------------------------------------------------------------
+  // Index into ItemTable::items, items with identical stats share one index.
+  using ItemSlot = uint32_t;
+  constexpr ItemSlot NO_ITEM = std::numeric_limits<ItemSlot>::max();
+  constexpr uint32_t NO_ROOM = std::numeric_limits<uint32_t>::max();
+
+  struct ItemTable {
+    std::vector<EquippedItem> items;
+    std::vector<std::vector<ItemSlot> > roomItems; // roomItems[room][itemIndex]
+    std::vector<std::vector<ItemId> > pickups; // Item indices of each room worth picking up
+    size_t dominatedItems = 0;
+
+    // Items in `known` keep their index, so states of an earlier table stay valid.
+    explicit ItemTable(const std::vector<Room> &rooms, const std::vector<EquippedItem> &known = {})
+      : items(known), roomItems(rooms.size()), pickups(rooms.size()) {
+      std::map<EquippedItem, ItemSlot> ids;
+      for (ItemSlot slot = 0; slot < known.size(); slot++) ids.try_emplace(known[slot], slot);
+      for (RoomId r = 0; r < rooms.size(); r++) {
+        roomItems[r].reserve(rooms[r].items.size());
+        for (auto &item: rooms[r].items) {
+          auto [it, inserted] = ids.try_emplace(EquippedItem::fromItem(item), ItemSlot(items.size()));
+          if (inserted) items.push_back(it->first);
+          roomItems[r].push_back(it->second);
+        }
+        prunePickups(r);
+      }
+    }
+
+  private:
+    // Picking up a dominated item never helps when the better one lies in the same room.
+    // Of several identical items only the first one is kept.
+    void prunePickups(RoomId r) {
+      const auto &local = roomItems[r];
+      for (ItemId i = 0; i < local.size(); i++) {
+        bool dominated = false;
+        for (ItemId j = 0; j < local.size() && !dominated; j++) {
+          if (i == j || !items[local[j]].dominates(items[local[i]])) continue;
+          dominated = local[i] != local[j] || j < i;
+        }
+        if (dominated) dominatedItems++;
+        else pickups[r].push_back(i);
+      }
+    }
+  };
+
+  // -------------------------------------------------------------------------------
+  // Combat stats of many fighters as structure of arrays.
+  struct StatColumns {
+    std::span<const int> hp, off, def, stacking_off, stacking_def;
+
+    size_t size() const { return hp.size(); }
+
+    Monster at(size_t i) const {
+      return {.hp = hp[i], .off = off[i], .def = def[i], .stacking_off = stacking_off[i], .stacking_def = stacking_def[i]};
+    }
+  };
+
+  // StatColumns while they are being filled.
+  struct StatArrays {
+    std::vector<int> hp, off, def, stacking_off, stacking_def;
+
+    void push_back(int h, int o, int d, int so, int sd) {
+      hp.push_back(h);
+      off.push_back(o);
+      def.push_back(d);
+      stacking_off.push_back(so);
+      stacking_def.push_back(sd);
+    }
+
+    void push_back(const Monster &m) { push_back(m.hp, m.off, m.def, m.stacking_off, m.stacking_def); }
+
+    void clear() {
+      for (auto *column: {&hp, &off, &def, &stacking_off, &stacking_def}) column->clear();
+    }
+
+    StatColumns columns() const { return {hp, off, def, stacking_off, stacking_def}; }
+  };
+
+  // simulate_combat over `count` pairs, hero(i), foe(i) and heroFirst(i) describing the i-th,
+  // heroWins[i] set when the hero wins it. The first pass assumes no stacking stats, which
+  // makes every fight one division per side in straight-line code without branches or calls.
+  // The second pass redoes the fights where stacking stats change the damage per turn.
+  template<typename Hero, typename Foe, typename First>
+  void fightAll(size_t count, Hero &&hero, Foe &&foe, First &&heroFirst, std::span<uint8_t> heroWins) {
+    constexpr int64_t NEVER = int64_t(1) << 62;
+    auto turns = [](int64_t hp, int64_t dmg) { return dmg > 0 ? (hp + dmg - 1) / std::max<int64_t>(dmg, 1) : NEVER; };
+    for (size_t i = 0; i < count; i++) {
+      Monster h = hero(i), f = foe(i);
+      bool first = heroFirst(i);
+      int64_t heroTurns = turns(f.hp, int64_t(h.off) - f.def - (first ? 0 : f.stacking_def));
+      int64_t foeTurns = turns(h.hp, int64_t(f.off) - h.def - (first ? h.stacking_def : 0));
+      heroWins[i] = heroTurns != NEVER && (first ? heroTurns <= foeTurns : heroTurns < foeTurns);
+    }
+    for (size_t i = 0; i < count; i++) {
+      Monster h = hero(i), f = foe(i);
+      if (h.stacking_off == f.stacking_def && f.stacking_off == h.stacking_def) continue;
+      heroWins[i] = heroFirst(i) ? simulate_combat(h, f) == A_WINS : simulate_combat(f, h) == B_WINS;
+    }
+  }
+
+  // One hero against every monster in `monsters`.
+  void simulate_combat(const Monster &hero, bool heroFirst, StatColumns monsters, std::span<uint8_t> heroWins) {
+    fightAll(monsters.size(), [&](size_t) { return hero; }, [&](size_t i) { return monsters.at(i); },
+             [&](size_t) { return heroFirst; }, heroWins);
+  }
+
+  // Every hero in `heroes`, the i-th striking first if heroFirst[i], against one monster.
+  void simulate_combat(StatColumns heroes, std::span<const uint8_t> heroFirst, const Monster &monster,
+                       std::span<uint8_t> heroWins) {
+    fightAll(heroes.size(), [&](size_t i) { return heroes.at(i); }, [&](size_t) { return monster; },
+             [&](size_t i) { return bool(heroFirst[i]); }, heroWins);
+  }
+
+  // Calls fn on every array of a Dungeon, or of the DungeonArrays it is built from, in image order.
+  constexpr size_t DUNGEON_COLUMNS = 19;
+
+  template<typename Columns, typename Fn>
+  void forEachColumn(Columns &c, Fn &&fn) {
+    fn(c.neighborStart);
+    fn(c.neighbors);
+    fn(c.pickupStart);
+    fn(c.pickupIndex);
+    fn(c.pickupSlot);
+    fn(c.monsterOf);
+    for (auto *stats: {&c.monsters, &c.itemStats}) {
+      fn(stats->hp);
+      fn(stats->off);
+      fn(stats->def);
+      fn(stats->stacking_off);
+      fn(stats->stacking_def);
+    }
+    fn(c.itemType);
+    fn(c.itemFirstAttack);
+    fn(c.itemStealth);
+  }
+
+  // The arrays of a Dungeon, filled from the rooms.
+  struct DungeonArrays {
+    std::vector<uint32_t> neighborStart, neighbors;
+    std::vector<uint32_t> pickupStart;
+    std::vector<uint32_t> pickupIndex;
+    std::vector<ItemSlot> pickupSlot;
+    std::vector<uint32_t> monsterOf;
+    StatArrays monsters;
+    std::vector<Item::Type> itemType;
+    StatArrays itemStats;
+    std::vector<uint8_t> itemFirstAttack, itemStealth;
+    size_t dominatedItems;
+
+    explicit DungeonArrays(const std::vector<Room> &rooms, const std::vector<EquippedItem> &known = {})
+      : monsterOf(rooms.size(), std::numeric_limits<uint32_t>::max()) { // Dungeon::NO_MONSTER
+      const ItemTable table(rooms, known);
+      dominatedItems = table.dominatedItems;
+
+      neighborStart.reserve(rooms.size() + 1);
+      pickupStart.reserve(rooms.size() + 1);
+      for (RoomId r = 0; r < rooms.size(); r++) {
+        neighborStart.push_back(uint32_t(neighbors.size()));
+        for (auto n: rooms[r].neighbors) neighbors.push_back(uint32_t(n));
+
+        pickupStart.push_back(uint32_t(pickupIndex.size()));
+        for (auto i: table.pickups[r]) {
+          pickupIndex.push_back(uint32_t(i));
+          pickupSlot.push_back(table.roomItems[r][i]);
+        }
+
+        if (auto &m = rooms[r].monster) {
+          monsterOf[r] = uint32_t(monsters.hp.size());
+          monsters.push_back(m->hp, m->off, m->def, m->stacking_off, m->stacking_def);
+        }
+      }
+      neighborStart.push_back(uint32_t(neighbors.size()));
+      pickupStart.push_back(uint32_t(pickupIndex.size()));
+
+      for (auto &item: table.items) {
+        itemType.push_back(item.type);
+        itemStats.push_back(item.hp, item.off, item.def, item.stacking_off, item.stacking_def);
+        itemFirstAttack.push_back(item.first_attack);
+        itemStealth.push_back(item.stealth);
+      }
+    }
+  };
+
+  // -------------------------------------------------------------------------------
+  // Dungeon image, the format of dungeon files and of a Dungeon's own storage: this header,
+  // then every column in forEachColumn order and the stored entrances, each padded to 8 bytes.
+  // Numbers are in native byte order.
+  struct DungeonHeader {
+    static constexpr uint64_t MAGIC = 0x314e554447314741; // "AG1GDUN1"
+    static constexpr uint32_t VERSION = 1;
+
+    uint64_t magic;
+    uint32_t version;
+    uint32_t treasure; // NO_ROOM when no query is stored
+    uint64_t roomCount, dominatedItems, entranceCount;
+    std::array<uint64_t, DUNGEON_COLUMNS> lengths;
+  };
+
+  template<typename T>
+  constexpr size_t imageBytes(size_t count) { return (count * sizeof(T) + 7) / 8 * 8; }
+
+  std::vector<uint64_t> encodeDungeon(
+    const DungeonArrays &arrays,
+    size_t roomCount,
+    const std::vector<RoomId> &entrances,
+    uint32_t treasure
+  ) {
+    DungeonHeader header = {
+      .magic = DungeonHeader::MAGIC, .version = DungeonHeader::VERSION, .treasure = treasure,
+      .roomCount = roomCount, .dominatedItems = arrays.dominatedItems, .entranceCount = entrances.size(),
+      .lengths = {},
+    };
+    size_t size = sizeof header, column = 0;
+    forEachColumn(arrays, [&](auto &values) {
+      header.lengths[column++] = values.size();
+      size += imageBytes<typename std::remove_cvref_t<decltype(values)>::value_type>(values.size());
+    });
+    size += imageBytes<uint32_t>(entrances.size());
+
+    std::vector<uint64_t> image(size / 8);
+    auto *bytes = reinterpret_cast<std::byte *>(image.data());
+    std::memcpy(bytes, &header, sizeof header);
+    size_t offset = sizeof header;
+    forEachColumn(arrays, [&](auto &values) {
+      using T = typename std::remove_cvref_t<decltype(values)>::value_type;
+      if (!values.empty()) std::memcpy(bytes + offset, values.data(), values.size() * sizeof(T));
+      offset += imageBytes<T>(values.size());
+    });
+    for (auto entrance: entrances) {
+      uint32_t room = uint32_t(entrance);
+      std::memcpy(bytes + offset, &room, sizeof room);
+      offset += sizeof room;
+    }
+    return image;
+  }
+
+  // Hands out the arrays of an image one after another. Throws std::runtime_error when the
+  // image is not one or it is too short for the sizes it states.
+  class ImageReader {
+  public:
+    explicit ImageReader(std::span<const std::byte> image) : image(image) {
+      if (image.size() < sizeof(DungeonHeader)) throw std::runtime_error("dungeon image too short");
+      header = reinterpret_cast<const DungeonHeader *>(image.data());
+      if (header->magic != DungeonHeader::MAGIC) throw std::runtime_error("not a dungeon image");
+      if (header->version != DungeonHeader::VERSION) throw std::runtime_error("unsupported dungeon image version");
+      offset = sizeof(DungeonHeader);
+    }
+
+    const DungeonHeader &info() const { return *header; }
+
+    template<typename T>
+    std::span<const T> next(uint64_t count) {
+      if (count > (image.size() - offset) / sizeof(T)) throw std::runtime_error("dungeon image truncated");
+      std::span<const T> values(reinterpret_cast<const T *>(image.data() + offset), count);
+      offset += std::min(imageBytes<T>(count), image.size() - offset);
+      return values;
+    }
+
+  private:
+    std::span<const std::byte> image;
+    const DungeonHeader *header;
+    size_t offset;
+  };
+
+  // Frozen copy of the rooms the solver runs on. Neighbours and pickups of all rooms are
+  // stored back to back in compressed sparse row form (room r owns [start[r], start[r + 1])),
+  // monsters and interned item stats as structures of arrays, so walking the dungeon never
+  // chases a per-room heap pointer. The arrays are views into an image, either built in
+  // memory or mapped from a dungeon file, which copies of the Dungeon share.
+  struct Dungeon {
+    static constexpr uint32_t NO_MONSTER = std::numeric_limits<uint32_t>::max();
+
+    size_t roomCount;
+    std::span<const uint32_t> neighborStart, neighbors;
+    std::span<const uint32_t> pickupStart;
+    std::span<const uint32_t> pickupIndex; // Index into Room::items, as used by Pickup
+    std::span<const ItemSlot> pickupSlot;
+    std::span<const uint32_t> monsterOf; // NO_MONSTER or index into monsters
+    StatColumns monsters;
+
+    // Interned item stats, indexed by ItemSlot.
+    std::span<const Item::Type> itemType;
+    StatColumns itemStats;
+    std::span<const uint8_t> itemFirstAttack, itemStealth;
+    size_t dominatedItems;
+
+    // Items in `known` keep their ItemSlot, see items().
+    explicit Dungeon(const std::vector<Room> &rooms, const std::vector<EquippedItem> &known = {})
+      : Dungeon(std::make_shared<const std::vector<uint64_t> >(
+        encodeDungeon(DungeonArrays(rooms, known), rooms.size(), {}, NO_ROOM))) {}
+
+    // Views the columns `reader` is at, `storage` keeps the image alive.
+    Dungeon(std::shared_ptr<const void> storage, ImageReader &reader)
+      : roomCount(reader.info().roomCount), dominatedItems(reader.info().dominatedItems), storage(std::move(storage)) {
+      size_t column = 0;
+      forEachColumn(*this, [&](auto &values) {
+        using T = typename std::remove_cvref_t<decltype(values)>::value_type;
+        values = reader.next<T>(reader.info().lengths[column++]);
+      });
+
+      auto sized = [](const StatColumns &stats, size_t count) {
+        return stats.off.size() == count && stats.def.size() == count
+               && stats.stacking_off.size() == count && stats.stacking_def.size() == count;
+      };
+      bool consistent = neighborStart.size() == roomCount + 1 && pickupStart.size() == roomCount + 1
+                        && monsterOf.size() == roomCount && neighborStart.back() == neighbors.size()
+                        && pickupStart.back() == pickupIndex.size() && pickupSlot.size() == pickupIndex.size()
+                        && sized(monsters, monsters.size()) && sized(itemStats, itemType.size())
+                        && itemStats.size() == itemType.size() && itemFirstAttack.size() == itemType.size()
+                        && itemStealth.size() == itemType.size();
+      if (!consistent) throw std::runtime_error("dungeon image is inconsistent");
+      if (!inRange()) throw std::runtime_error("dungeon image refers past its arrays");
+    }
+
+    std::span<const uint32_t> neighborsOf(RoomId r) const {
+      return {neighbors.data() + neighborStart[r], neighbors.data() + neighborStart[r + 1]};
+    }
+
+    bool hasMonster(RoomId r) const { return monsterOf[r] != NO_MONSTER; }
+
+    Monster monster(RoomId r) const { return monsters.at(monsterOf[r]); }
+
+    // The interned items, indexed by ItemSlot.
+    std::vector<EquippedItem> items() const {
+      std::vector<EquippedItem> items;
+      for (ItemSlot slot = 0; slot < itemType.size(); slot++) {
+        Monster stats = itemStats.at(slot);
+        items.push_back({
+          .type = itemType[slot], .hp = stats.hp, .off = stats.off, .def = stats.def,
+          .stacking_off = stats.stacking_off, .stacking_def = stats.stacking_def,
+          .first_attack = bool(itemFirstAttack[slot]), .stealth = bool(itemStealth[slot]),
+        });
+      }
+      return items;
+    }
+
+  private:
+    std::shared_ptr<const void> storage;
+
+    // Whether every offset and id the search follows stays inside its array: the row starts
+    // never decrease, and rooms, monsters, items and item types are all known.
+    bool inRange() const {
+      auto rows = [](std::span<const uint32_t> start) {
+        return start.front() == 0 && std::ranges::is_sorted(start);
+      };
+      auto below = [](auto values, size_t bound) {
+        return std::ranges::all_of(values, [&](auto v) { return size_t(v) < bound; });
+      };
+      return rows(neighborStart) && rows(pickupStart) && below(neighbors, roomCount)
+             && below(pickupSlot, itemType.size()) && below(itemType, size_t(Item::TYPE_COUNT))
+             && std::ranges::all_of(monsterOf, [&](uint32_t m) { return m == NO_MONSTER || m < monsters.size(); });
+    }
+
+    explicit Dungeon(std::shared_ptr<const std::vector<uint64_t> > image)
+      : Dungeon(image, ImageReader(std::as_bytes(std::span(*image)))) {}
+
+    Dungeon(std::shared_ptr<const void> storage, ImageReader &&reader) : Dungeon(std::move(storage), reader) {}
+  };
+
+  // A dungeon together with the query stored in its file.
+  struct DungeonFile {
+    Dungeon dungeon;
+    std::vector<RoomId> entrances;
+    RoomId treasure;
+  };
+
+  // Converts rooms and a query into a dungeon file for map_dungeon_file. Throws
+  // std::invalid_argument when a room id is out of range, the file stores them in 32 bits.
+  void write_dungeon_file(
+    const std::string &path,
+    const std::vector<Room> &rooms,
+    const std::vector<RoomId> &entrances,
+    RoomId treasure
+  ) {
+    auto outside = [&](RoomId room) { return room >= rooms.size(); };
+    bool valid = rooms.size() < NO_ROOM && std::ranges::none_of(entrances, outside)
+                 && (treasure == NO_ROOM || !outside(treasure))
+                 && std::ranges::all_of(rooms, [&](const Room &room) {
+                   return std::ranges::none_of(room.neighbors, outside);
+                 });
+    if (!valid) throw std::invalid_argument("room id out of range for a dungeon file");
+
+    auto image = encodeDungeon(DungeonArrays(rooms), rooms.size(), entrances, uint32_t(treasure));
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(image.data()), std::streamsize(image.size() * sizeof(uint64_t)));
+    if (!out) throw std::runtime_error("cannot write " + path);
+  }
+
+  // Maps a dungeon file read-only. Nothing is copied but the entrances, and the mapping lives
+  // as long as any copy of the Dungeon. Its offsets and ids are checked once here, the stats
+  // are read in as the search touches them. Throws std::runtime_error when the file is no
+  // dungeon image, refers past its own arrays or its query names a room it does not have.
+  DungeonFile map_dungeon_file(const std::string &path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) throw std::runtime_error("cannot open " + path);
+    struct stat st;
+    if (fstat(fd, &st) < 0) {
+      close(fd);
+      throw std::runtime_error("cannot stat " + path);
+    }
+
+    size_t size = size_t(st.st_size);
+    void *data = size ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : nullptr;
+    close(fd);
+    if (data == MAP_FAILED) throw std::runtime_error("cannot map " + path);
+    std::shared_ptr<const void> mapping(data, [size](const void *p) {
+      if (p) munmap(const_cast<void *>(p), size);
+    });
+
+    ImageReader reader({static_cast<const std::byte *>(data), size});
+    Dungeon dungeon(mapping, reader);
+    auto entrances = reader.next<uint32_t>(reader.info().entranceCount);
+    auto outside = [&](uint32_t room) { return room >= dungeon.roomCount; };
+    if (std::ranges::any_of(entrances, outside)) throw std::runtime_error("dungeon file entrance out of range");
+    uint32_t treasure = reader.info().treasure;
+    if (treasure != NO_ROOM && outside(treasure)) throw std::runtime_error("dungeon file treasure out of range");
+    return {std::move(dungeon), {entrances.begin(), entrances.end()}, treasure};
+  }
+
   // -------------------------------------------------------------------------------
   struct State {
-    RoomId room;
-    bool hasTreasure;
-    std::vector<EquippedItem> equipped;
+    uint32_t room;
+    std::array<ItemSlot, Item::TYPE_COUNT> slots;
+    bool hasTreasure = false;
     bool usedStealth = false;
 
-    bool operator==(const State &o) const {
-      return room == o.room && hasTreasure == o.hasTreasure &&
-             equipped == o.equipped && usedStealth == o.usedStealth;
-    }
+    friend bool operator==(const State &, const State &) = default;
+
+    bool hasStealth(const Dungeon &dungeon) const {
+      for (auto slot: slots) {
+        if (slot != NO_ITEM && dungeon.itemStealth[slot]) return true;
+      }
+      return false;
+    }
+
+    bool hasFirstAttack(const Dungeon &dungeon) const {
+      for (auto slot: slots) {
+        if (slot != NO_ITEM && dungeon.itemFirstAttack[slot]) return true;
+      }
+      return false;
+    }
+
+    void equipItem(ItemSlot item, const Dungeon &dungeon) {
+      slots[dungeon.itemType[item]] = item;
+    }
+
+    void dropItem(Item::Type type) {
+      slots[type] = NO_ITEM;
+    }
+  };
+
+  // Index of a discovered state in the solver's record table.
+  using StateId = uint32_t;
+  constexpr StateId NO_PARENT = std::numeric_limits<StateId>::max();
+
+  // Per-state bookkeeping. The State itself is only stored as the key mapping to this record.
+  struct StateRecord {
+    StateId parent; // NO_PARENT for states entered from outside the dungeon
+    uint32_t dist;
+    Action action;
+  };
+
+  // -------------------------------------------------------------------------------
+  // hp, off, def, stacking_off and stacking_def side by side, so adding up a loadout is
+  // one lane-wise add per item that the compiler does in vector registers.
+  struct StatLanes {
+    std::array<int, 5> lanes;
+
+    static constexpr StatLanes of(const Monster &m) {
+      return {{m.hp, m.off, m.def, m.stacking_off, m.stacking_def}};
+    }
+
+    constexpr StatLanes &operator+=(const StatLanes &o) {
+      for (size_t i = 0; i < lanes.size(); i++) lanes[i] += o.lanes[i];
+      return *this;
+    }
+
+    // Stats as they fight, the hero is never left with less than 1 hp.
+    constexpr Monster fighter() const {
+      return {.hp = std::max(lanes[0], 1), .off = lanes[1], .def = lanes[2],
+              .stacking_off = lanes[3], .stacking_def = lanes[4]};
+    }
+  };
+
+  constexpr StatLanes HERO_STATS = {{10000, 3, 2, 0, 0}};
+  static_assert(HERO_STATS.fighter().hp == 10000);
+
+  static Monster calcFighterStats(const State &state, const Dungeon &dungeon) {
+    StatLanes stats = HERO_STATS;
+    for (auto slot: state.slots) {
+      if (slot != NO_ITEM) stats += StatLanes::of(dungeon.itemStats.at(slot));
+    }
+    return stats.fighter();
+  }
+
+  // --------------------------------------------------------------------------------
+  // splitmix64 finalizer, every input bit affects every output bit.
+  static uint64_t mix64(uint64_t x) {
+    x ^= x >> 30;
+    x *= 0xbf58476d1ce4e5b9ULL;
+    x ^= x >> 27;
+    x *= 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return x;
+  }
+
+  // Slots are already in Item::Type order, so the hash is chained over them
+  // (equal items in different slots or repeated items never cancel out).
+  struct StateHash {
+    std::size_t operator()(const State &s) const {
+      uint64_t h = mix64(uint64_t(s.room) << 2 | uint64_t(s.hasTreasure) << 1 | uint64_t(s.usedStealth));
+      for (auto slot: s.slots) {
+        h = mix64(h ^ (slot + 0x9e3779b97f4a7c15ULL));
+      }
+      return h;
+    }
+  };
+
+  // Insert-only open-addressing hash map with linear probing. All entries live
+  // in one contiguous array, so a lookup touches one or two cache lines instead
+  // of a chain of heap nodes. Keys and values must be default constructible.
+  template<typename Key, typename Value, typename Hash>
+  class FlatHashMap {
+  public:
+    FlatHashMap() : FlatHashMap(16) {}
+
+    explicit FlatHashMap(size_t capacity) { rehash(capacity); }
+
+    size_t size() const { return _size; }
+
+    size_t bytes() const { return _entries.capacity() * sizeof(_entries[0]) + _used.capacity(); }
+
+    void reserve(size_t count) {
+      if (count * 8 > _entries.size() * 7) rehash(count * 8 / 7 + 1);
+    }
+
+    // Returns the value stored under `key` and whether it was inserted now.
+    // Only an insertion can grow the table, so hits never move entries around.
+    template<typename... Args>
+    std::pair<Value *, bool> try_emplace(const Key &key, Args &&... args) {
+      size_t i = slotFor(key);
+      if (_used[i]) return {&_entries[i].second, false};
+      if ((_size + 1) * 8 > _entries.size() * 7) {
+        reserve(_size + 1);
+        i = slotFor(key);
+      }
+      _used[i] = true;
+      _entries[i] = {key, Value(std::forward<Args>(args)...)};
+      _size++;
+      return {&_entries[i].second, true};
+    }
+
+    Value &operator[](const Key &key) { return *try_emplace(key).first; }
+
+    Value *find(const Key &key) {
+      size_t i = slotFor(key);
+      return _used[i] ? &_entries[i].second : nullptr;
+    }
+
+    const Value *find(const Key &key) const {
+      size_t i = slotFor(key);
+      return _used[i] ? &_entries[i].second : nullptr;
+    }
+
+    bool contains(const Key &key) const { return find(key) != nullptr; }
+
+  private:
+    std::vector<std::pair<Key, Value> > _entries;
+    std::vector<uint8_t> _used;
+    size_t _size = 0;
+    size_t _shift = 64;
+    Hash _hash;
+
+    // Fibonacci hashing spreads the hash over the power-of-two table.
+    size_t home(const Key &key) const {
+      return (uint64_t(_hash(key)) * 0x9e3779b97f4a7c15ULL) >> _shift;
+    }
+
+    // Slot holding `key`, or the empty slot where it would be inserted.
+    size_t slotFor(const Key &key) const {
+      size_t mask = _entries.size() - 1;
+      for (size_t i = home(key);; i = (i + 1) & mask) {
+        if (!_used[i] || _entries[i].first == key) return i;
+      }
+    }
+
+    void rehash(size_t capacity) {
+      size_t bits = 1;
+      while ((size_t(1) << bits) < capacity) bits++;
+
+      auto entries = std::move(_entries);
+      auto used = std::move(_used);
+      _entries.assign(size_t(1) << bits, {});
+      _used.assign(size_t(1) << bits, false);
+      _shift = 64 - bits;
+
+      for (size_t i = 0; i < used.size(); i++) {
+        if (!used[i]) continue;
+        size_t j = slotFor(entries[i].first);
+        _used[j] = true;
+        _entries[j] = std::move(entries[i]);
+      }
+    }
+  };
+
+  // -------------------------------------------------------------------------------
+  struct CombatKey {
+    std::array<int, 5> hero, monster; // hp, off, def, stacking_off, stacking_def
+    bool heroFirst;
+
+    friend bool operator==(const CombatKey &, const CombatKey &) = default;
+
+    static std::array<int, 5> pack(const Monster &m) {
+      return {m.hp, m.off, m.def, m.stacking_off, m.stacking_def};
+    }
+  };
+
+  struct CombatKeyHash {
+    std::size_t operator()(const CombatKey &k) const {
+      uint64_t h = k.heroFirst;
+      for (size_t i = 0; i < k.hero.size(); i++) {
+        h = mix64(h ^ (uint64_t(uint32_t(k.hero[i])) << 32 | uint32_t(k.monster[i])));
+      }
+      return h;
+    }
+  };
+
+  // Remembers the outcome of every fight by the stats of both sides, so states
+  // that share a loadout (and dungeons with few distinct monsters) simulate
+  // each fight once. Can be shared between several find_shortest_path calls.
+  struct CombatCache {
+    size_t hits = 0, misses = 0;
+
+    bool heroSurvives(const Monster &hero, bool heroFirst, const Monster &monster) {
+      CombatKey key = {.hero = CombatKey::pack(hero), .monster = CombatKey::pack(monster), .heroFirst = heroFirst};
+      auto [survives, inserted] = results.try_emplace(key, false);
+      if (!inserted) {
+        hits++;
+        return *survives;
+      }
+
+      misses++;
+      *survives = heroFirst
+                    ? simulate_combat(hero, monster) == A_WINS
+                    : simulate_combat(monster, hero) == B_WINS;
+      return *survives;
+    }
+
+    // heroSurvives against every monster in `monsters`. Every fight gets its entry in one
+    // pass (the table is grown first, so none of them moves), the ones the cache has not seen
+    // yet are then simulated together in one batch.
+    void heroSurvives(const Monster &hero, bool heroFirst, StatColumns monsters, std::span<uint8_t> survives) {
+      CombatKey key = {.hero = CombatKey::pack(hero), .monster = {}, .heroFirst = heroFirst};
+      results.reserve(results.size() + monsters.size());
+      entries.clear();
+      unknown.clear();
+      fights.clear();
+      for (uint32_t m = 0; m < monsters.size(); m++) {
+        key.monster = CombatKey::pack(monsters.at(m));
+        auto [result, inserted] = results.try_emplace(key, false);
+        (inserted ? misses : hits)++; // The same monster twice in one batch is fought once
+        entries.push_back(result);
+        if (!inserted) continue;
+        unknown.push_back(result);
+        fights.push_back(monsters.at(m));
+      }
+
+      wins.resize(unknown.size());
+      simulate_combat(hero, heroFirst, fights.columns(), wins);
+      for (size_t i = 0; i < unknown.size(); i++) *unknown[i] = wins[i];
+      for (uint32_t m = 0; m < monsters.size(); m++) survives[m] = *entries[m];
+    }
+
+    size_t bytes() const { return results.bytes(); }
+
+  private:
+    FlatHashMap<CombatKey, bool, CombatKeyHash> results;
+    // Scratch for the batch heroSurvives
+    std::vector<bool *> entries, unknown;
+    StatArrays fights;
+    std::vector<uint8_t> wins;
+  };
+
+  // Number of actions on the parent chain ending in `current`.
+  size_t pathLength(const std::vector<StateRecord> &records, StateId current) {
+    size_t length = 0;
+    for (; current != NO_PARENT; current = records[current].parent) length++;
+    return length;
+  }
+
+  // Writes the chain ending in `current` into `path`, which must hold exactly
+  // pathLength(records, current) actions. The chain is walked goal-first, so the
+  // buffer is filled back to front and never reversed.
+  void reconstructPath(const std::vector<StateRecord> &records, StateId current, std::span<Action> path) {
+    for (size_t i = path.size(); current != NO_PARENT; current = records[current].parent) {
+      path[--i] = records[current].action;
+    }
+  }
+
+  std::vector<Action> reconstructPath(
+    const std::vector<StateRecord> &records,
+    StateId current
+  ) {
+    std::vector<Action> path(pathLength(records, current));
+    reconstructPath(records, current, path);
+    return path;
+  }
+
+  // -------------------------------------------------------------------------------------------------
+  void print_path(std::span<const Action> path) {
+    std::cout << "Path (" << path.size() << " actions): ";
+    for (size_t i = 0; i < path.size(); ++i) {
+      if (i > 0) std::cout << " -> ";
+
+      if (auto m = std::get_if<Move>(&path[i])) {
+        std::cout << "Move(" << m->room << ")";
+      } else if (auto p = std::get_if<Pickup>(&path[i])) {
+        std::cout << "Pickup(" << p->item << ")";
+      } else if (auto d = std::get_if<Drop>(&path[i])) {
+        std::cout << "Drop(";
+        if (d->type == Item::Weapon) std::cout << "Weapon";
+        else if (d->type == Item::Armor) std::cout << "Armor";
+        else if (d->type == Item::RubberDuck) std::cout << "Duck";
+        std::cout << ")";
+      }
+    }
+    std::cout << std::endl;
+  }
+
+  enum class Passage : uint8_t {
+    OPEN, // No monster or the hero wins
+    SNEAK,
+    BLOCKED,
+  };
+
+  // How the hero with the loadout of `state` gets into `room`.
+  Passage passageInto(const Dungeon &dungeon, CombatCache &combat, const State &state, RoomId room) {
+    if (!dungeon.hasMonster(room)) return Passage::OPEN;
+    Monster heroObj = calcFighterStats(state, dungeon);
+    if (combat.heroSurvives(heroObj, state.hasFirstAttack(dungeon), dungeon.monster(room))) return Passage::OPEN;
+    return state.hasStealth(dungeon) ? Passage::SNEAK : Passage::BLOCKED;
+  }
+
+  // Moves the hero into `room`. Returns nothing if the hero dies there.
+  std::optional<State> enterRoom(State state, RoomId room, RoomId treasure, Passage passage) {
+    if (passage == Passage::BLOCKED) return {};
+    state.room = uint32_t(room);
+    state.usedStealth = passage == Passage::SNEAK;
+    if (room == treasure && !state.usedStealth)
+      state.hasTreasure = true;
+    return state;
+  }
+
+  std::optional<State> enterRoom(
+    const Dungeon &dungeon,
+    CombatCache &combat,
+    State state,
+    RoomId room,
+    RoomId treasure
+  ) {
+    return enterRoom(state, room, treasure, passageInto(dungeon, combat, state, room));
+  }
+
+  // -------------------------------------------------------------------------------
+  using Loadout = std::array<ItemSlot, Item::TYPE_COUNT>;
+
+  struct LoadoutHash {
+    std::size_t operator()(const Loadout &slots) const {
+      uint64_t h = 0;
+      for (auto slot: slots) {
+        h = mix64(h ^ (slot + 0x9e3779b97f4a7c15ULL));
+      }
+      return h;
+    }
+  };
+
+  // For every distinct loadout, two bitmaps over the dungeon's monsters: the ones already
+  // fought and, of those, the ones the hero beats. A loadout's maps are allocated when it is
+  // first seen and filled lazily: the monsters next to a room are fought, in one batch, the
+  // first time the search moves out of it with the loadout. Afterwards a passage is a bit test.
+  class LoadoutMaps {
+  public:
+    LoadoutMaps(const Dungeon &dungeon, CombatCache &combat)
+      : dungeon(dungeon), combat(combat), words((dungeon.monsters.size() + 63) / 64) {}
+
+    size_t size() const { return ids.size(); }
+
+    size_t bytes() const {
+      return ids.bytes() + heroes.capacity() * sizeof(Hero) + bits.capacity() * sizeof(uint64_t);
+    }
+
+    // Id of the maps of the loadout in `state`, allocated on first use.
+    uint32_t of(const State &state) {
+      auto [id, inserted] = ids.try_emplace(state.slots, uint32_t(ids.size()));
+      if (inserted) {
+        heroes.push_back({
+          .stats = calcFighterStats(state, dungeon),
+          .firstAttack = state.hasFirstAttack(dungeon),
+          .stealth = state.hasStealth(dungeon),
+        });
+        bits.resize(bits.size() + 2 * words, 0);
+      }
+      return *id;
+    }
+
+    // Fights the monsters in `rooms` the loadout has not fought yet, all in one batch.
+    void fight(uint32_t maps, std::span<const uint32_t> rooms) {
+      pending.clear();
+      monsters.clear();
+      for (auto room: rooms) {
+        uint32_t monster = dungeon.monsterOf[room];
+        if (monster == Dungeon::NO_MONSTER) continue;
+        uint64_t &fought = bits[(2 * maps) * words + monster / 64];
+        uint64_t bit = uint64_t(1) << (monster % 64);
+        if (fought & bit) continue;
+        fought |= bit;
+        pending.push_back(monster);
+        monsters.push_back(dungeon.monsters.at(monster));
+      }
+      if (pending.empty()) return;
+
+      const Hero &hero = heroes[maps];
+      beaten.resize(pending.size());
+      combat.heroSurvives(hero.stats, hero.firstAttack, monsters.columns(), beaten);
+      for (size_t i = 0; i < pending.size(); i++) {
+        if (beaten[i]) bits[(2 * maps + 1) * words + pending[i] / 64] |= uint64_t(1) << (pending[i] % 64);
+      }
+    }
+
+    Passage passage(uint32_t maps, RoomId room) {
+      uint32_t monster = dungeon.monsterOf[room];
+      if (monster == Dungeon::NO_MONSTER) return Passage::OPEN;
+      uint64_t bit = uint64_t(1) << (monster % 64);
+      if (!(bits[(2 * maps) * words + monster / 64] & bit)) {
+        uint32_t only = uint32_t(room);
+        fight(maps, {&only, 1});
+      }
+      if (bits[(2 * maps + 1) * words + monster / 64] & bit) return Passage::OPEN;
+      return heroes[maps].stealth ? Passage::SNEAK : Passage::BLOCKED;
+    }
+
+  private:
+    struct Hero {
+      Monster stats;
+      bool firstAttack, stealth;
+    };
+
+    const Dungeon &dungeon;
+    CombatCache &combat;
+    size_t words;
+    FlatHashMap<Loadout, uint32_t, LoadoutHash> ids;
+    std::vector<Hero> heroes; // By maps id
+    std::vector<uint64_t> bits; // Fought then beaten monsters, `words` each, per loadout
+    // Scratch for fight
+    std::vector<uint32_t> pending;
+    StatArrays monsters;
+    std::vector<uint8_t> beaten;
+  };
+
+  // -------------------------------------------------------------------------------
+  // What one find_shortest_path call did. Times are wall-clock seconds.
+  struct SearchStats {
+    size_t statesExpanded = 0;
+    size_t statesDiscovered = 0;
+    size_t peakFrontier = 0; // Deque length, largest layer of the level-synchronous search or deepest IDA* path
+    size_t combatLookups = 0;
+    size_t combatSimulations = 0; // Lookups the combat cache could not answer
+    size_t loadoutMaps = 0; // Distinct loadouts (per worker) whose monster maps were allocated
+    size_t dominatedItems = 0;
+    size_t peakMemory = 0; // Bytes the search's own tables took at most, including combat cache growth
+    double setupTime = 0, searchTime = 0, reconstructTime = 0;
+  };
+
+  struct SearchOptions {
+    // Only search rooms that lie on some entrance -> treasure -> entrance route of the room graph.
+    bool routePruning = false;
+    // 0 runs the serial 0-1 BFS, n > 0 a level-synchronous BFS on n threads
+    // that returns the same path for every n.
+    unsigned threads = 0;
+    // Best-first (A*) on moves plus a room-level bound on the moves left, instead of the 0-1 BFS.
+    bool astar = false;
+    // Nonzero runs the IDA* search instead, keeping its tables within about this many bytes.
+    // Still exact, but it revisits states and is slower the tighter the limit is. Throws
+    // std::invalid_argument when not even the tables kept per room fit.
+    size_t memoryLimit = 0;
+    bool printPath = false;
+    // Filled in when set.
+    SearchStats *stats = nullptr;
+    // Called with every state (and its distance) before it is expanded, always on the calling thread.
+    std::function<void(const State &, uint32_t)> trace = {};
+  };
+
+  // Rooms reachable from `sources`, `neighbors(room)` lists the rooms one step away.
+  template<typename Neighbors>
+  static std::vector<bool> reachableRooms(size_t roomCount, const std::vector<RoomId> &sources,
+                                          const Neighbors &neighbors) {
+    std::vector<bool> seen(roomCount, false);
+    std::vector<RoomId> stack;
+    for (auto room: sources) {
+      if (!seen[room]) stack.push_back(room);
+      seen[room] = true;
+    }
+    while (!stack.empty()) {
+      RoomId room = stack.back();
+      stack.pop_back();
+      for (auto next: neighbors(room)) {
+        if (!seen[next]) stack.push_back(next);
+        seen[next] = true;
+      }
+    }
+    return seen;
+  }
+
+  // Room-level BFS distances from the nearest source, UNREACHABLE where there is no path.
+  constexpr uint32_t UNREACHABLE = std::numeric_limits<uint32_t>::max();
+
+  template<typename Neighbors>
+  static std::vector<uint32_t> roomDistances(size_t roomCount, const std::vector<RoomId> &sources,
+                                             const Neighbors &neighbors) {
+    std::vector<uint32_t> dist(roomCount, UNREACHABLE);
+    std::vector<RoomId> queue;
+    for (auto room: sources) {
+      if (dist[room] == UNREACHABLE) queue.push_back(room);
+      dist[room] = 0;
+    }
+    for (size_t i = 0; i < queue.size(); i++) {
+      for (auto next: neighbors(queue[i])) {
+        if (dist[next] != UNREACHABLE) continue;
+        dist[next] = dist[queue[i]] + 1;
+        queue.push_back(next);
+      }
+    }
+    return dist;
+  }
+
+  // Dungeon::neighbors with every edge turned around, in the same CSR layout.
+  struct ReversedRooms {
+    std::vector<uint32_t> start, rooms;
+
+    explicit ReversedRooms(const Dungeon &dungeon)
+      : start(dungeon.roomCount + 1, 0), rooms(dungeon.neighbors.size()) {
+      for (auto to: dungeon.neighbors) start[to + 1]++;
+      for (size_t r = 0; r < dungeon.roomCount; r++) start[r + 1] += start[r];
+      std::vector<uint32_t> fill(start.begin(), start.end() - 1);
+      for (RoomId r = 0; r < dungeon.roomCount; r++) {
+        for (auto to: dungeon.neighborsOf(r)) rooms[fill[to]++] = uint32_t(r);
+      }
+    }
+
+    std::span<const uint32_t> neighborsOf(RoomId r) const {
+      return {rooms.data() + start[r], rooms.data() + start[r + 1]};
+    }
+  };
+
+  // Lower bound on the moves a state still needs: room-level BFS distances to the treasure
+  // (unless carried) and from there to the nearest entrance. Monsters and items only ever
+  // make routes longer, so the bound is admissible, and consistent as one move changes it
+  // by at most one.
+  struct MoveBounds {
+    std::vector<uint32_t> toTreasure, toExit;
+    uint32_t treasureToExit;
+
+    MoveBounds(const Dungeon &dungeon, const std::vector<RoomId> &entrances, RoomId treasure) {
+      const ReversedRooms reversed(dungeon);
+      auto backward = [&](RoomId r) { return reversed.neighborsOf(r); };
+      toTreasure = roomDistances(dungeon.roomCount, {treasure}, backward);
+      toExit = roomDistances(dungeon.roomCount, entrances, backward);
+      treasureToExit = toExit[treasure];
+    }
+
+    uint32_t operator()(const State &s) const {
+      if (s.hasTreasure) return toExit[s.room];
+      if (toTreasure[s.room] == UNREACHABLE || treasureToExit == UNREACHABLE) return UNREACHABLE;
+      return toTreasure[s.room] + treasureToExit;
+    }
+
+    size_t bytes() const { return (toTreasure.capacity() + toExit.capacity()) * sizeof(uint32_t); }
+  };
+
+  // Rooms that some entrance -> treasure (or treasure -> entrance) walk of the room graph
+  // passes through, ignoring monsters and items. Only prunes the state search, there is
+  // no backward state search to join with. A state off these regions can never be part
+  // of a route, so skipping it keeps the result exact.
+  struct RouteRegions {
+    static constexpr size_t MAX_CHECKED_LOADOUTS = 1 << 12;
+
+    std::vector<bool> toTreasure, toExit;
+    bool treasureReachable = false;
+
+    RouteRegions(const Dungeon &dungeon, const std::vector<RoomId> &entrances, RoomId treasure,
+                 CombatCache &combat) {
+      const size_t n = dungeon.roomCount;
+
+      const ReversedRooms reversed(dungeon);
+      auto forward = [&](RoomId r) { return dungeon.neighborsOf(r); };
+      auto backward = [&](RoomId r) { return reversed.neighborsOf(r); };
+
+      toTreasure = reachableRooms(n, entrances, forward);
+      auto treasureBack = reachableRooms(n, {treasure}, backward);
+      toExit = reachableRooms(n, {treasure}, forward);
+      auto entrancesBack = reachableRooms(n, entrances, backward);
+      for (RoomId r = 0; r < n; r++) {
+        toTreasure[r] = toTreasure[r] && treasureBack[r];
+        toExit[r] = toExit[r] && entrancesBack[r];
+      }
+
+      treasureReachable = toTreasure[treasure] && toExit[treasure] && canTakeTreasure(dungeon, treasure, combat);
+    }
+
+    bool allows(const State &s) const {
+      return (s.hasTreasure ? toExit : toTreasure)[s.room];
+    }
+
+    size_t bytes() const { return (toTreasure.capacity() + toExit.capacity()) / 8; }
+
+  private:
+    // Tries every loadout made of items on the way to the treasure against its guard.
+    bool canTakeTreasure(const Dungeon &dungeon, RoomId treasure, CombatCache &combat) const {
+      if (!dungeon.hasMonster(treasure)) return true;
+
+      std::array<std::vector<ItemSlot>, Item::TYPE_COUNT> byType;
+      for (auto &slots: byType) slots.push_back(NO_ITEM);
+      std::vector<bool> seen(dungeon.itemType.size(), false);
+      for (RoomId r = 0; r < dungeon.roomCount; r++) {
+        if (!toTreasure[r]) continue;
+        for (uint32_t p = dungeon.pickupStart[r]; p < dungeon.pickupStart[r + 1]; p++) {
+          ItemSlot item = dungeon.pickupSlot[p];
+          if (!seen[item]) byType[dungeon.itemType[item]].push_back(item);
+          seen[item] = true;
+        }
+      }
+
+      size_t loadouts = 1;
+      for (auto &slots: byType) loadouts *= slots.size();
+      if (loadouts > MAX_CHECKED_LOADOUTS) return true;
+
+      State hero = {.room = NO_ROOM, .slots = {NO_ITEM, NO_ITEM, NO_ITEM}};
+      for (size_t i = 0; i < loadouts; i++) {
+        for (size_t type = 0, rest = i; type < Item::TYPE_COUNT; rest /= byType[type].size(), type++) {
+          hero.slots[type] = byType[type][rest % byType[type].size()];
+        }
+        auto entered = enterRoom(dungeon, combat, hero, treasure, treasure);
+        if (entered && entered->hasTreasure) return true;
+      }
+      return false;
+    }
+  };
+
+  // Everything the searches need to know about one query.
+  struct SearchSpace {
+    const Dungeon &dungeon;
+    RoomId treasure;
+    std::vector<bool> isEntrance;
+    std::optional<RouteRegions> regions;
+
+    SearchSpace(const Dungeon &dungeon, const std::vector<RoomId> &entrances, RoomId treasure,
+                CombatCache &combat, const SearchOptions &options)
+      : dungeon(dungeon), treasure(treasure), isEntrance(dungeon.roomCount, false) {
+      for (auto &en: entrances) isEntrance[en] = true;
+      // The regions cost memory per room only, and spare the bounded search dead ends.
+      if (options.routePruning || options.memoryLimit) regions.emplace(dungeon, entrances, treasure, combat);
+    }
+
+    bool unsolvable() const { return regions && !regions->treasureReachable; }
+
+    size_t bytes() const { return isEntrance.capacity() / 8 + (regions ? regions->bytes() : 0); }
+
+    bool isGoal(const State &s) const { return s.hasTreasure && isEntrance[s.room]; }
+
+    bool allows(const State &s) const { return !regions || regions->allows(s); }
+
+    // States the hero starts in, one per entrance he survives entering.
+    template<typename Visit>
+    void forEachStart(const std::vector<RoomId> &entrances, CombatCache &combat, Visit &&visit) const {
+      State outside = {.room = NO_ROOM, .slots = {NO_ITEM, NO_ITEM, NO_ITEM}};
+      for (auto &en: entrances) {
+        auto s = enterRoom(dungeon, combat, outside, en, treasure);
+        if (s && allows(*s)) visit(*s, Action{Move{en}});
+      }
+    }
+
+    // Pickups and drops, they do not cost a room.
+    template<typename Visit>
+    void forEachFreeStep(const State &current, Visit &&visit) const {
+      if (!current.usedStealth) {
+        for (uint32_t p = dungeon.pickupStart[current.room]; p < dungeon.pickupStart[current.room + 1]; p++) {
+          ItemSlot item = dungeon.pickupSlot[p];
+          if (current.slots[dungeon.itemType[item]] == item) continue;
+          auto next = current;
+          next.equipItem(item, dungeon);
+          if (allows(next)) visit(next, Action{Pickup{dungeon.pickupIndex[p]}});
+        }
+      }
+
+      for (uint8_t type = 0; type < Item::TYPE_COUNT; type++) {
+        if (current.slots[type] == NO_ITEM) continue;
+        auto next = current;
+        next.dropItem(Item::Type(type));
+        if (allows(next)) visit(next, Action{Drop{Item::Type(type)}});
+      }
+    }
+
+    template<typename Visit>
+    void forEachMove(const State &current, LoadoutMaps &maps, Visit &&visit) const {
+      uint32_t loadout = maps.of(current);
+      maps.fight(loadout, dungeon.neighborsOf(current.room));
+      for (auto neighbour: dungeon.neighborsOf(current.room)) {
+        auto next = enterRoom(current, neighbour, treasure, maps.passage(loadout, neighbour));
+        if (next && allows(*next)) visit(*next, Action{Move{neighbour}});
+      }
+    }
+  };
+
+  // 0-1 BFS: pickups and drops are free, moves cost one room.
+  // Goes one distance at a time: waves of free steps until no new state turns up, then the
+  // moves out of the whole layer. Every state keeps the parent it was first discovered from,
+  // which is the order levelSynchronousSearch merges in, so both return the same path.
+  // Returns the goal state, the route to it is recorded in `records`.
+  std::optional<StateId> zeroOneSearch(const SearchSpace &space, const std::vector<RoomId> &entrances,
+                                       CombatCache &combat, const SearchOptions &options,
+                                       std::vector<StateRecord> &records, SearchStats &stats) {
+    using Layer = std::vector<std::pair<State, StateId> >;
+    FlatHashMap<State, StateId, StateHash> ids;
+    LoadoutMaps maps(space.dungeon, combat);
+
+    auto discover = [&](Layer &into, const State &next, uint32_t dist, StateId parent, const Action &action) {
+      auto [id, inserted] = ids.try_emplace(next, StateId(records.size()));
+      if (!inserted) return;
+      records.push_back({.parent = parent, .dist = dist, .action = action});
+      into.emplace_back(next, *id);
+    };
+
+    Layer wave;
+    space.forEachStart(entrances, combat, [&](const State &s, const Action &action) {
+      discover(wave, s, 0, NO_PARENT, action);
+    });
+
+    std::optional<StateId> goalId;
+    for (uint32_t dist = 0; !wave.empty() && !goalId; dist++) {
+      Layer layer;
+      while (!wave.empty()) {
+        auto goal = std::ranges::find_if(wave, [&](auto &entry) { return space.isGoal(entry.first); });
+        if (goal != wave.end()) {
+          goalId = goal->second;
+          break;
+        }
+        if (options.trace) {
+          for (auto &[state, id]: wave) options.trace(state, dist);
+        }
+        stats.statesExpanded += wave.size();
+        stats.peakFrontier = std::max(stats.peakFrontier, wave.size());
+        Layer next;
+        for (auto &[state, id]: wave) {
+          space.forEachFreeStep(state, [&](const State &to, const Action &action) {
+            discover(next, to, dist, id, action);
+          });
+        }
+        layer.insert(layer.end(), wave.begin(), wave.end());
+        wave = std::move(next);
+      }
+      if (!goalId) {
+        stats.peakFrontier = std::max(stats.peakFrontier, layer.size());
+        for (auto &[state, id]: layer) {
+          space.forEachMove(state, maps, [&](const State &to, const Action &action) {
+            discover(wave, to, dist + 1, id, action);
+          });
+        }
+      }
+    }
+    stats.loadoutMaps = maps.size();
+    stats.peakMemory = records.capacity() * sizeof(StateRecord) + ids.bytes() + maps.bytes()
+                       + 2 * stats.peakFrontier * sizeof(Layer::value_type);
+    return goalId;
+  }
+
+  // Threads that stay up for a whole search and run one job at a time on all of them.
+  // The calling thread works as worker 0, so a pool of one worker starts no thread.
+  class WorkerPool {
+  public:
+    explicit WorkerPool(unsigned workers) {
+      for (unsigned w = 1; w < workers; w++) _threads.emplace_back([this, w] { work(w); });
+    }
+
+    WorkerPool(const WorkerPool &) = delete;
+    WorkerPool &operator=(const WorkerPool &) = delete;
+
+    ~WorkerPool() {
+      {
+        std::lock_guard lock(_mutex);
+        _stopping = true;
+        _generation++;
+      }
+      _wake.notify_all();
+      for (auto &t: _threads) t.join();
+    }
+
+    unsigned size() const { return unsigned(_threads.size()) + 1; }
+
+    static constexpr size_t MIN_CHUNK = 256;
+
+    // Runs fn(worker, begin, end) over [0, count) split into contiguous chunks, one per worker.
+    // Small inputs are not worth waking threads for and run on the calling thread.
+    template<typename Fn>
+    void forEachChunk(size_t count, Fn &&fn) {
+      unsigned workers = unsigned(std::clamp<size_t>(count / MIN_CHUNK, 1, size()));
+      size_t chunk = (count + workers - 1) / workers;
+      if (workers == 1) {
+        fn(0u, size_t(0), count);
+        return;
+      }
+      run([&](unsigned w) {
+        if (w < workers) fn(w, std::min(count, w * chunk), std::min(count, (w + 1) * chunk));
+      });
+    }
+
+    // Runs fn(worker) on every worker, all of them on the calling thread when there is less
+    // than a chunk of `work` in total.
+    template<typename Fn>
+    void forEachWorker(size_t work, Fn &&fn) {
+      if (work < MIN_CHUNK) {
+        for (unsigned w = 0; w < size(); w++) fn(w);
+        return;
+      }
+      run(fn);
+    }
+
+  private:
+    void run(const std::function<void(unsigned)> &job) {
+      {
+        std::lock_guard lock(_mutex);
+        _job = &job;
+        _pending = _threads.size();
+        _generation++;
+      }
+      _wake.notify_all();
+      job(0);
+      std::unique_lock lock(_mutex);
+      _finished.wait(lock, [&] { return _pending == 0; });
+      _job = nullptr;
+    }
+
+    void work(unsigned worker) {
+      uint64_t done = 0;
+      std::unique_lock lock(_mutex);
+      while (true) {
+        _wake.wait(lock, [&] { return _generation != done; });
+        done = _generation;
+        if (_stopping) return;
+        lock.unlock();
+        (*_job)(worker);
+        lock.lock();
+        if (--_pending == 0) _finished.notify_one();
+      }
+    }
+
+    std::mutex _mutex;
+    std::condition_variable _wake, _finished;
+    const std::function<void(unsigned)> *_job = nullptr;
+    size_t _pending = 0;
+    uint64_t _generation = 0;
+    bool _stopping = false;
+    std::vector<std::thread> _threads;
+  };
+
+  // State set of the level-synchronous search, split by hash into shards with a lock each, so
+  // workers insert into it concurrently. A state found in the running wave keeps the lowest
+  // rank it was found with (its parent's position in the layer, then the step's among the
+  // parent's), which is what a serial search would have found it with first. Settled states
+  // keep rank 0.
+  class StateShards {
+  public:
+    static constexpr size_t SHARDS = 64;
+    static constexpr uint64_t SETTLED = 0;
+
+    static uint64_t rank(size_t parent, uint32_t step) { return uint64_t(parent) << 32 | (uint64_t(step) + 1); }
+
+    // Whether `rank` is the lowest `s` was found with so far; false once it is settled.
+    bool offer(const State &s, uint64_t rank) {
+      Shard &shard = shardOf(s);
+      std::lock_guard lock(shard.mutex);
+      auto [lowest, inserted] = shard.ranks.try_emplace(s, rank);
+      if (inserted) return true;
+      if (rank >= *lowest) return false;
+      *lowest = rank;
+      return true;
+    }
+
+    // Settles `s` if it still has `rank`, returns whether it did.
+    bool settle(const State &s, uint64_t rank) {
+      Shard &shard = shardOf(s);
+      std::lock_guard lock(shard.mutex);
+      uint64_t *lowest = shard.ranks.find(s);
+      if (*lowest != rank) return false;
+      *lowest = SETTLED;
+      return true;
+    }
+
+    size_t bytes() const {
+      size_t bytes = sizeof(*this);
+      for (auto &shard: shards) bytes += shard.ranks.bytes();
+      return bytes;
+    }
+
+  private:
+    struct alignas(64) Shard {
+      std::mutex mutex;
+      FlatHashMap<State, uint64_t, StateHash> ranks;
+    };
+    std::array<Shard, SHARDS> shards;
+
+    Shard &shardOf(const State &s) { return shards[StateHash{}(s) % SHARDS]; }
+  };
+
+  // Level-synchronous BFS: zeroOneSearch with every distance layer (and every wave of free
+  // steps inside it) expanded in parallel on one WorkerPool. Workers insert what they find
+  // into StateShards themselves and keep the finds that had the lowest rank at the time.
+  // Once the wave is done they drop the ones that lost it later, and the rest, taken worker
+  // by worker, are in exactly the order zeroOneSearch discovers them, so the path does not
+  // depend on the number of threads.
+  std::optional<StateId> levelSynchronousSearch(const SearchSpace &space, const std::vector<RoomId> &entrances,
+                                                CombatCache &combat, const SearchOptions &options,
+                                                std::vector<StateRecord> &records, SearchStats &stats) {
+    const unsigned threads = options.threads;
+    struct Discovery {
+      State state;
+      StateId parent;
+      Action action;
+      uint64_t rank;
+    };
+    using Layer = std::vector<std::pair<State, StateId> >;
+
+    StateShards ids;
+    std::vector<CombatCache> caches(threads);
+    std::vector<LoadoutMaps> maps;
+    maps.reserve(threads);
+    for (auto &cache: caches) maps.emplace_back(space.dungeon, cache);
+    std::vector<std::vector<Discovery> > found(threads);
+    WorkerPool pool(threads);
+
+    // Records the discoveries that kept their rank at `dist`, in rank order.
+    auto merge = [&](uint32_t dist) {
+      size_t total = 0;
+      for (auto &discoveries: found) total += discoveries.size();
+      pool.forEachWorker(total, [&](unsigned worker) {
+        std::erase_if(found[worker], [&](const Discovery &d) { return !ids.settle(d.state, d.rank); });
+      });
+
+      std::vector<size_t> offsets(threads + 1, 0);
+      for (unsigned w = 0; w < threads; w++) offsets[w + 1] = offsets[w] + found[w].size();
+      size_t first = records.size();
+      records.resize(first + offsets.back());
+      Layer layer(offsets.back());
+      pool.forEachWorker(offsets.back(), [&](unsigned worker) {
+        size_t i = offsets[worker];
+        for (auto &[state, parent, action, rank]: found[worker]) {
+          records[first + i] = {.parent = parent, .dist = dist, .action = action};
+          layer[i] = {state, StateId(first + i)};
+          i++;
+        }
+        found[worker].clear();
+      });
+      return layer;
+    };
+
+    auto expand = [&](const Layer &layer, bool moves) {
+      stats.peakFrontier = std::max(stats.peakFrontier, layer.size());
+      pool.forEachChunk(layer.size(), [&](unsigned worker, size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+          uint32_t step = 0;
+          auto visit = [&](const State &next, const Action &action) {
+            uint64_t rank = StateShards::rank(i, step++);
+            if (ids.offer(next, rank)) found[worker].push_back({next, layer[i].second, action, rank});
+          };
+          if (moves) space.forEachMove(layer[i].first, maps[worker], visit);
+          else space.forEachFreeStep(layer[i].first, visit);
+        }
+      });
+    };
+
+    uint32_t start = 0;
+    space.forEachStart(entrances, combat, [&](const State &s, const Action &action) {
+      uint64_t rank = StateShards::rank(0, start++);
+      if (ids.offer(s, rank)) found[0].push_back({s, NO_PARENT, action, rank});
+    });
+    Layer wave = merge(0);
+
+    std::optional<StateId> goalId;
+    for (uint32_t dist = 0; !wave.empty() && !goalId; dist++) {
+      Layer layer;
+      while (!wave.empty()) {
+        auto goal = std::ranges::find_if(wave, [&](auto &entry) { return space.isGoal(entry.first); });
+        if (goal != wave.end()) {
+          goalId = goal->second;
+          break;
+        }
+        if (options.trace) {
+          for (auto &[state, id]: wave) options.trace(state, dist);
+        }
+        stats.statesExpanded += wave.size();
+        expand(wave, false);
+        layer.insert(layer.end(), wave.begin(), wave.end());
+        wave = merge(dist);
+      }
+      if (!goalId) {
+        expand(layer, true);
+        wave = merge(dist + 1);
+      }
+    }
+
+    for (auto &cache: caches) {
+      combat.hits += cache.hits;
+      combat.misses += cache.misses;
+    }
+    stats.peakMemory = records.capacity() * sizeof(StateRecord) + ids.bytes() + 2 * stats.peakFrontier * sizeof(Layer::value_type);
+    for (auto &workerMaps: maps) {
+      stats.loadoutMaps += workerMaps.size();
+      stats.peakMemory += workerMaps.bytes();
+    }
+    for (auto &cache: caches) stats.peakMemory += cache.bytes();
+    return goalId;
+  }
+
+  // IDA*: depth-first searches cut off at moves + MoveBounds above a limit, raising the limit
+  // to the lowest value cut off until a goal turns up, so the first goal found is a nearest one.
+  // Pickups and drops are folded into the moves: before each move a node tries every loadout
+  // its room allows. Every step therefore costs one move and a path never runs in circles.
+  // Memory is the current path plus a fixed-size transposition table that cuts off states
+  // already reached as cheaply in the same iteration. States pushed out of the table are
+  // simply searched again. Once that happens the table can no longer show that nothing is
+  // left to find, so a treasure out of reach is proven by a sweep over one bit per state,
+  // when that fits in an eighth of the limit. Without it the search ends only at `states`.
+  std::optional<StateId> idaSearch(const SearchSpace &space, const std::vector<RoomId> &entrances,
+                                   CombatCache &combat, const SearchOptions &options,
+                                   std::vector<StateRecord> &records, SearchStats &stats) {
+    const Dungeon &dungeon = space.dungeon;
+    const MoveBounds bound(dungeon, entrances, space.treasure);
+
+    std::vector<std::pair<State, Action> > starts;
+    space.forEachStart(entrances, combat, [&](const State &s, const Action &action) { starts.emplace_back(s, action); });
+    uint32_t limit = UNREACHABLE;
+    for (auto &[s, action]: starts) limit = std::min(limit, bound(s));
+    // Tables kept per room and per entrance whatever the limit. The search space's own count
+    // against the limit too, find_shortest_path adds them to the peak.
+    const size_t fixed = bound.bytes() + starts.capacity() * sizeof(starts[0]);
+
+    // Transposition table, WAYS entries per set; a set takes the state in its first free or stale
+    // entry, otherwise the one reached with the most moves is dropped. Together with the fixed
+    // tables it gets up to three quarters of the limit, the rest is left for the path and the
+    // combat cache.
+    struct Seen {
+      State state;
+      uint32_t moves;
+      uint32_t iteration = 0;
+    };
+    constexpr size_t WAYS = 4;
+    if (space.bytes() + fixed + WAYS * sizeof(Seen) > options.memoryLimit / 4 * 3) {
+      throw std::invalid_argument("memory limit too small for the dungeon");
+    }
+    size_t sets = 1;
+    while (space.bytes() + fixed + 2 * sets * WAYS * sizeof(Seen) <= options.memoryLimit / 4 * 3) sets *= 2;
+    std::vector<Seen> seen(sets * WAYS);
+    auto setOf = [&](const State &s) { return std::span(seen).subspan((StateHash{}(s) & (sets - 1)) * WAYS, WAYS); };
+    auto find = [&](const State &s, uint32_t iteration) -> Seen * {
+      for (auto &slot: setOf(s)) {
+        if (slot.iteration == iteration && slot.state == s) return &slot;
+      }
+      return nullptr;
+    };
+
+    // A state on the current path with the loadout and neighbour it tries next.
+    struct Frame {
+      State state; // As entered
+      Action entry;
+      std::array<uint32_t, Item::TYPE_COUNT> choice; // Per type 0 keeps, 1 drops, 2 + p takes pickup p of the room
+      uint32_t neighbor;
+    };
+    std::vector<Frame> path;
+
+    auto pickup = [&](const Frame &f, uint32_t choice) { return dungeon.pickupStart[f.state.room] + choice - 2; };
+    auto valid = [&](const Frame &f) {
+      for (uint8_t type = 0; type < Item::TYPE_COUNT; type++) {
+        uint32_t c = f.choice[type];
+        if (c == 1 && f.state.slots[type] == NO_ITEM) return false;
+        if (c < 2) continue;
+        ItemSlot item = dungeon.pickupSlot[pickup(f, c)];
+        if (f.state.usedStealth || dungeon.itemType[item] != type || f.state.slots[type] == item) return false;
+      }
+      return true;
+    };
+    auto nextChoice = [&](Frame &f) {
+      uint32_t radix = 2 + dungeon.pickupStart[f.state.room + 1] - dungeon.pickupStart[f.state.room];
+      do {
+        size_t type = 0;
+        while (type < Item::TYPE_COUNT && ++f.choice[type] == radix) f.choice[type++] = 0;
+        if (type == Item::TYPE_COUNT) return false;
+      } while (!valid(f));
+      return true;
+    };
+    auto loadout = [&](const Frame &f) {
+      State s = f.state;
+      for (uint8_t type = 0; type < Item::TYPE_COUNT; type++) {
+        if (f.choice[type] == 1) s.dropItem(Item::Type(type));
+        else if (f.choice[type] >= 2) s.equipItem(dungeon.pickupSlot[pickup(f, f.choice[type])], dungeon);
+      }
+      return s;
+    };
+    // The actions of the path into `records`, returns the id of the last one.
+    auto record = [&] {
+      StateId parent = NO_PARENT;
+      auto add = [&](uint32_t moves, const Action &action) {
+        records.push_back({.parent = parent, .dist = moves, .action = action});
+        parent = StateId(records.size() - 1);
+      };
+      for (uint32_t moves = 0; moves < path.size(); moves++) {
+        const Frame &f = path[moves];
+        add(moves, f.entry);
+        if (moves + 1 == path.size()) break;
+        for (uint8_t type = 0; type < Item::TYPE_COUNT; type++) {
+          if (f.choice[type] == 1) add(moves, Drop{Item::Type(type)});
+          else if (f.choice[type] >= 2) add(moves, Pickup{dungeon.pickupIndex[pickup(f, f.choice[type])]});
+        }
+      }
+      return parent;
+    };
+
+    size_t sweepBytes = 0;
+    auto done = [&](std::optional<StateId> goal) {
+      stats.peakMemory = fixed + seen.capacity() * sizeof(Seen) + path.capacity() * sizeof(Frame) + sweepBytes;
+      return goal;
+    };
+
+    // Whether the states in the table of `iteration` are all it can reach. If the table held
+    // every state of the iteration, nothing is left to find and the treasure is out of reach.
+    // A start or successor the limit cut off is not in the table and keeps the search open.
+    auto exhausted = [&](uint32_t iteration) {
+      auto open = [&](const State &s) { return bound(s) != UNREACHABLE && !find(s, iteration); };
+      if (std::ranges::any_of(starts, [&](auto &start) { return open(start.first); })) return false;
+      for (auto &slot: seen) {
+        if (slot.iteration != iteration) continue;
+        Frame f = {.state = slot.state, .entry = {}, .choice = {}, .neighbor = 0};
+        do {
+          State from = loadout(f);
+          for (auto to: dungeon.neighborsOf(from.room)) {
+            auto next = enterRoom(dungeon, combat, from, to, space.treasure);
+            if (next && space.allows(*next) && open(*next)) return false;
+          }
+        } while (nextChoice(f));
+      }
+      return true;
+    };
+
+    // A nearest goal is never further than there are states. Past that, states still cut
+    // off only sit on paths that run in circles, where the table lost track of them.
+    uint64_t states = 4 * uint64_t(dungeon.roomCount);
+    std::array<uint64_t, Item::TYPE_COUNT> perType = {1, 1, 1};
+    for (auto type: dungeon.itemType) perType[type]++;
+    for (auto count: perType) states = std::min<uint64_t>(states * count, UNREACHABLE - 1);
+
+    // Whether the starts reach a goal at all: marks every state they reach in a bitmap over
+    // the whole state space, sweeping it until no new state turns up. Nothing when the bitmap
+    // would take more than an eighth of the limit.
+    auto sweep = [&]() -> std::optional<bool> {
+      uint64_t bits = 4 * uint64_t(dungeon.roomCount);
+      for (auto count: perType) {
+        if (bits > options.memoryLimit / count) return {};
+        bits *= count;
+      }
+
+      // A slot's number among the items of its type, 0 for none, and back.
+      std::vector<uint32_t> number(dungeon.itemType.size());
+      std::array<std::vector<ItemSlot>, Item::TYPE_COUNT> numbered;
+      for (auto &slots: numbered) slots.push_back(NO_ITEM);
+      for (ItemSlot slot = 0; slot < number.size(); slot++) {
+        auto &slots = numbered[dungeon.itemType[slot]];
+        number[slot] = uint32_t(slots.size());
+        slots.push_back(slot);
+      }
+      auto index = [&](const State &s) {
+        uint64_t i = s.room;
+        for (uint8_t type = 0; type < Item::TYPE_COUNT; type++) {
+          i = i * perType[type] + (s.slots[type] == NO_ITEM ? 0 : number[s.slots[type]]);
+        }
+        return (i * 2 + s.hasTreasure) * 2 + s.usedStealth;
+      };
+      auto stateAt = [&](uint64_t i) {
+        State s = {.room = 0, .slots = {}, .hasTreasure = false, .usedStealth = bool(i % 2)};
+        s.hasTreasure = (i /= 2) % 2;
+        i /= 2;
+        for (int type = Item::TYPE_COUNT - 1; type >= 0; type--) {
+          s.slots[type] = numbered[type][i % perType[type]];
+          i /= perType[type];
+        }
+        s.room = uint32_t(i);
+        return s;
+      };
+
+      std::vector<uint64_t> reached((bits + 63) / 64, 0);
+      sweepBytes = reached.capacity() * sizeof(uint64_t);
+      bool grew = false, goal = false;
+      auto mark = [&](const State &s, const Action &) {
+        uint64_t i = index(s);
+        if (reached[i / 64] >> (i % 64) & 1) return;
+        reached[i / 64] |= uint64_t(1) << (i % 64);
+        grew = true;
+        goal |= space.isGoal(s);
+      };
+      for (auto &[s, action]: starts) mark(s, action);
+      while (grew && !goal) {
+        grew = false;
+        for (uint64_t i = 0; i < bits && !goal; i++) {
+          if (!(reached[i / 64] >> (i % 64) & 1)) continue;
+          State s = stateAt(i);
+          space.forEachFreeStep(s, mark);
+          for (auto to: dungeon.neighborsOf(s.room)) {
+            auto next = enterRoom(dungeon, combat, s, to, space.treasure);
+            if (next && space.allows(*next)) mark(*next, Action{Move{to}});
+          }
+        }
+      }
+      return goal;
+    };
+    bool swept = false;
+
+    size_t expanded = 0; // Distinct states of the last iteration, as long as the table kept them all
+    for (uint32_t iteration = 1; limit <= states; iteration++) {
+      uint32_t nextLimit = UNREACHABLE;
+      size_t fresh = 0;
+      bool evicted = false;
+      auto push = [&](const State &s, const Action &entry) {
+        uint32_t moves = uint32_t(path.size()), left = bound(s);
+        if (left == UNREACHABLE) return false;
+        // Expanded already, with at least as many moves to spare, so its cutoffs are counted too
+        Seen *slot = find(s, iteration);
+        if (slot && slot->moves <= moves) return false;
+        if (moves + left > limit) {
+          nextLimit = std::min(nextLimit, moves + left);
+          return false;
+        }
+        if (!slot) {
+          fresh++;
+          auto set = setOf(s);
+          slot = &*std::ranges::max_element(set, {}, [&](const Seen &e) {
+            return e.iteration == iteration ? int64_t(e.moves) : std::numeric_limits<int64_t>::max();
+          });
+          evicted |= slot->iteration == iteration;
+        }
+        *slot = {s, moves, iteration};
+
+        if (options.trace) options.trace(s, moves);
+        stats.statesExpanded++;
+        path.push_back({.state = s, .entry = entry, .choice = {}, .neighbor = 0});
+        stats.peakFrontier = std::max(stats.peakFrontier, path.size());
+        return true;
+      };
+
+      for (auto &[start, action]: starts) {
+        if (!push(start, action)) continue;
+        if (space.isGoal(start)) return done(record());
+
+        while (!path.empty()) {
+          Frame &top = path.back();
+          auto neighbors = dungeon.neighborsOf(top.state.room);
+          if (top.neighbor == neighbors.size()) {
+            top.neighbor = 0;
+            if (!nextChoice(top)) {
+              path.pop_back();
+              continue;
+            }
+          }
+          RoomId to = neighbors[top.neighbor++];
+          auto next = enterRoom(dungeon, combat, loadout(top), to, space.treasure);
+          if (!next || !space.allows(*next)) continue;
+          if (push(*next, Action{Move{to}}) && space.isGoal(*next)) return done(record());
+        }
+      }
+      // Nothing cut off lies outside the table, so a higher limit would find nothing new.
+      if (!evicted && fresh == expanded && exhausted(iteration)) nextLimit = UNREACHABLE;
+      // With states pushed out of the table that is never known, the sweep settles it once.
+      if (evicted && !swept) {
+        swept = true;
+        auto reachable = sweep();
+        if (reachable && !*reachable) nextLimit = UNREACHABLE;
+      }
+      expanded = evicted ? 0 : fresh;
+      limit = nextLimit;
+    }
+    return done({});
+  }
+
+  // Lower bound for a DialSearch that is not A*.
+  struct NoBound {
+    uint32_t operator()(const State &) const { return 0; }
+  };
+
+  // Dial's algorithm: a 0-1 BFS with one bucket per distance, so that states can be
+  // seeded at any distance and the search can be stopped and picked up again.
+  // With a consistent lower bound on the moves left it is A*, bucketed by distance + bound;
+  // states the bound rules out (UNREACHABLE) are dropped.
+  template<typename Bound = NoBound>
+  struct DialSearch {
+    Bound bound;
+    std::vector<StateRecord> records = {};
+    std::vector<State> states = {};
+    std::vector<StateId> source = {}; // With trackSource: the seed's source of every state seeded, else NO_PARENT
+    FlatHashMap<State, StateId, StateHash> ids = {};
+    std::vector<std::vector<std::pair<State, StateId> > > buckets = {};
+    uint32_t level = 0; // Bucket being expanded
+    size_t position = 0; // Next state of that bucket
+    size_t queued = 0, peakQueued = 0;
+    bool trackSource = false;
+
+    void relax(const State &next, uint32_t dist, StateId parent, const Action &action, StateId from = NO_PARENT) {
+      uint32_t left = bound(next);
+      if (left == UNREACHABLE) return;
+      auto [id, inserted] = ids.try_emplace(next, StateId(records.size()));
+      if (inserted) {
+        records.push_back({.parent = parent, .dist = dist, .action = action});
+        states.push_back(next);
+        if (trackSource) source.push_back(from);
+      } else {
+        if (records[*id].dist <= dist) return;
+        records[*id] = {.parent = parent, .dist = dist, .action = action};
+        if (trackSource) source[*id] = from;
+      }
+      if (buckets.size() <= dist + left) buckets.resize(dist + left + 1);
+      buckets[dist + left].emplace_back(next, *id);
+      peakQueued = std::max(peakQueued, ++queued);
+    }
+
+    // Expands states in distance order until one satisfies `stop`, which is returned and
+    // left unexpanded, or nothing is left. onExpand(state, dist) runs before each expansion.
+    template<typename Stop, typename OnExpand>
+    std::optional<StateId> run(const SearchSpace &space, LoadoutMaps &maps, Stop &&stop, OnExpand &&onExpand) {
+      for (; level < buckets.size(); level++, position = 0) {
+        for (; position < buckets[level].size(); position++) {
+          auto [current, currentId] = buckets[level][position];
+          queued--;
+          uint32_t dist = records[currentId].dist;
+          if (dist + bound(current) != level) continue; // Reached more cheaply since
+          if (stop(current)) return currentId;
+
+          onExpand(current, dist);
+          space.forEachFreeStep(current, [&](const State &next, const Action &action) {
+            relax(next, dist, currentId, action);
+          });
+          space.forEachMove(current, maps, [&](const State &next, const Action &action) {
+            relax(next, dist + 1, currentId, action);
+          });
+        }
+        std::vector<std::pair<State, StateId> >().swap(buckets[level]);
+      }
+      return {};
+    }
+  };
+
+  // A*: DialSearch ordered by moves + MoveBounds. It expands only the states whose bound
+  // still allows a route as short as the best one, and returns a nearest goal.
+  std::optional<StateId> astarSearch(const SearchSpace &space, const std::vector<RoomId> &entrances,
+                                     CombatCache &combat, const SearchOptions &options,
+                                     std::vector<StateRecord> &records, SearchStats &stats) {
+    const MoveBounds bounds(space.dungeon, entrances, space.treasure);
+    auto bound = [&](const State &s) { return bounds(s); };
+    DialSearch<decltype(bound)> search = {.bound = bound};
+    LoadoutMaps maps(space.dungeon, combat);
+
+    space.forEachStart(entrances, combat, [&](const State &s, const Action &action) {
+      search.relax(s, 0, NO_PARENT, action);
+    });
+    auto goal = search.run(space, maps, [&](const State &s) { return space.isGoal(s); },
+                           [&](const State &s, uint32_t dist) {
+                             if (options.trace) options.trace(s, dist);
+                             stats.statesExpanded++;
+                           });
+
+    stats.peakFrontier = search.peakQueued;
+    stats.loadoutMaps = maps.size();
+    stats.peakMemory = search.records.capacity() * sizeof(StateRecord) + search.states.capacity() * sizeof(State)
+                       + search.ids.bytes() + maps.bytes() + bounds.bytes()
+                       + search.peakQueued * sizeof(std::pair<State, StateId>);
+    records = std::move(search.records);
+    return goal;
+  }
+
+  // Runs the search selected by `options` and hands the records and the goal to `emit`,
+  // which turns them into whatever the caller returns. Returns what `emit` reported as
+  // the path, for printing; it is empty when no path exists.
+  template<typename Emit>
+  std::span<const Action> solve(
+    const Dungeon &dungeon,
+    const std::vector<RoomId> &entrances,
+    RoomId treasure,
+    CombatCache &combat,
+    const SearchOptions &options,
+    Emit emit
+  ) {
+    using Clock = std::chrono::steady_clock;
+    auto seconds = [](Clock::time_point since) {
+      return std::chrono::duration<double>(Clock::now() - since).count();
+    };
+    SearchStats stats;
+    size_t lookups = combat.hits + combat.misses, simulations = combat.misses, combatBytes = combat.bytes();
+    auto started = Clock::now();
+
+    const SearchSpace space(dungeon, entrances, treasure, combat, options);
+    stats.dominatedItems = dungeon.dominatedItems;
+    stats.setupTime = seconds(started);
+
+    std::span<const Action> path;
+    if (!space.unsolvable()) {
+      started = Clock::now();
+      std::vector<StateRecord> records;
+      auto goal = options.memoryLimit
+                    ? idaSearch(space, entrances, combat, options, records, stats)
+                    : options.astar
+                    ? astarSearch(space, entrances, combat, options, records, stats)
+                    : options.threads
+                    ? levelSynchronousSearch(space, entrances, combat, options, records, stats)
+                    : zeroOneSearch(space, entrances, combat, options, records, stats);
+      stats.statesDiscovered = records.size();
+      stats.searchTime = seconds(started);
+
+      started = Clock::now();
+      if (goal) path = emit(records, *goal);
+      stats.reconstructTime = seconds(started);
+    }
+
+    stats.combatLookups = combat.hits + combat.misses - lookups;
+    stats.combatSimulations = combat.misses - simulations;
+    stats.peakMemory += space.bytes() + combat.bytes() - combatBytes;
+    if (options.stats) *options.stats = stats;
+    if (options.printPath && !path.empty()) print_path(path);
+    return path;
+  }
+
+  std::vector<Action> find_shortest_path(
+    const Dungeon &dungeon,
+    const std::vector<RoomId> &entrances,
+    RoomId treasure,
+    CombatCache &combat,
+    const SearchOptions &options = {}
+  ) {
+    std::vector<Action> path;
+    solve(dungeon, entrances, treasure, combat, options,
+          [&](const std::vector<StateRecord> &records, StateId goal) {
+            path = reconstructPath(records, goal);
+            return std::span<const Action>(path);
+          });
+    return path;
+  }
+
+  // Same search, but the path is written to the front of a caller-supplied buffer, so
+  // repeated queries can reuse one allocation. Returns the number of actions in the
+  // shortest path (0 if there is none). If that is more than `out` holds, nothing is
+  // written and the caller can retry with a buffer of the returned size.
+  size_t find_shortest_path(
+    const Dungeon &dungeon,
+    const std::vector<RoomId> &entrances,
+    RoomId treasure,
+    CombatCache &combat,
+    std::span<Action> out,
+    const SearchOptions &options = {}
+  ) {
+    size_t length = 0;
+    solve(dungeon, entrances, treasure, combat, options,
+          [&](const std::vector<StateRecord> &records, StateId goal) {
+            length = pathLength(records, goal);
+            if (length > out.size()) return std::span<const Action>();
+            reconstructPath(records, goal, out.first(length));
+            return std::span<const Action>(out.first(length));
+          });
+    return length;
+  }
 
-    bool operator<(const State &o) const {
-      if (room != o.room) return room < o.room;
-      if (hasTreasure != o.hasTreasure) return hasTreasure < o.hasTreasure;
-      if (usedStealth != o.usedStealth) return usedStealth < o.usedStealth;
-      return equipped.size() < o.equipped.size();
-    }
+  std::vector<Action> find_shortest_path(
+    const std::vector<Room> &rooms,
+    const std::vector<RoomId> &entrances,
+    RoomId treasure,
+    CombatCache &combat,
+    const SearchOptions &options = {}
+  ) {
+    auto started = std::chrono::steady_clock::now();
+    const Dungeon dungeon(rooms);
+    std::chrono::duration<double> built = std::chrono::steady_clock::now() - started;
 
-    bool hasStealth() const {
-      for (auto &eq: equipped) {
-        if (eq.stealth) return true;
-      }
-      return false;
-    }
+    auto path = find_shortest_path(dungeon, entrances, treasure, combat, options);
+    if (options.stats) options.stats->setupTime += built.count();
+    return path;
+  }
 
-    bool hasFirstAttack() const {
-      for (auto &eq: equipped) {
-        if (eq.first_attack) return true;
-      }
-      return false;
-    }
+  std::vector<Action> find_shortest_path(
+    const std::vector<Room> &rooms,
+    const std::vector<RoomId> &entrances,
+    RoomId treasure
+  ) {
+    CombatCache combat;
+    return find_shortest_path(rooms, entrances, treasure, combat);
+  }
 
-    void replaceItem(const std::vector<Room> &rooms, RoomId &currentRoom, ItemId &itemIndex,
-                     std::vector<Action> &actions) {
-      const Item &newItem = rooms[currentRoom].items[itemIndex];
-      auto temp = *this;
-      auto it = std::ranges::find_if(equipped, [&](const EquippedItem &eq) {
-        return eq.type == newItem.type;
+  // -------------------------------------------------------------------------------
+  // Answers many treasure queries against one dungeon and set of entrances.
+  // Until the hero first walks into the treasure room, his moves do not depend on which
+  // room that is, so the treasure-free search from the entrances ("outbound") runs once,
+  // up front, over everything reachable. A query then only searches the way back: it
+  // starts from every outbound state standing in its treasure room, each at the distance
+  // it took to get there, and stops at the first entrance reached with the treasure.
+  class BatchSolver {
+  public:
+    BatchSolver(const Dungeon &dungeon, const std::vector<RoomId> &entrances, CombatCache &combat)
+      : maps(dungeon, combat), space(dungeon, entrances, NO_ROOM, combat, {}) {
+      space.forEachStart(entrances, combat, [&](const State &s, const Action &action) {
+        outbound.relax(s, 0, NO_PARENT, action);
       });
+      outbound.run(space, maps, [](const State &) { return false; }, [](const State &, uint32_t) {});
 
-      if (it != equipped.end()) {
-        actions.emplace_back(Drop{newItem.type});
-        equipped.erase(it);
+      // Outbound states by room (CSR), only those that walked in rather than sneaked.
+      const auto &states = outbound.states;
+      arrivalStart.assign(dungeon.roomCount + 1, 0);
+      for (auto &s: states) {
+        if (!s.usedStealth) arrivalStart[s.room + 1]++;
       }
-
-      equipped.emplace_back(EquippedItem::fromItem(rooms[currentRoom].items[itemIndex]));
-      actions.emplace_back(Pickup{itemIndex});
-    }
-
-    void equipItem(const Item &item) {
-      auto itemStruct = EquippedItem::fromItem(item);
-      auto it = std::ranges::find_if(equipped, [&](const EquippedItem &eq) {
-        return eq.type == itemStruct.type;
-      });
-      if (it == equipped.end()) {
-        equipped.emplace_back(itemStruct);
+      for (size_t r = 0; r < dungeon.roomCount; r++) arrivalStart[r + 1] += arrivalStart[r];
+      arrivals.resize(arrivalStart.back());
+      auto next = arrivalStart;
+      for (StateId id = 0; id < states.size(); id++) {
+        if (!states[id].usedStealth) arrivals[next[states[id].room]++] = id;
       }
     }
 
-    void dropItem(Item::Type type) {
-      auto it = std::ranges::find_if(equipped, [&](const EquippedItem &eq) {
-        return eq.type == type;
-      });
-      if (it != equipped.end()) {
-        equipped.erase(it);
+    size_t outboundSize() const { return outbound.states.size(); }
+
+    std::vector<Action> solve(RoomId treasure) {
+      DialSearch<> inbound;
+      inbound.trackSource = true;
+      for (uint32_t i = arrivalStart[treasure]; i < arrivalStart[treasure + 1]; i++) {
+        StateId id = arrivals[i];
+        State s = outbound.states[id];
+        s.hasTreasure = true;
+        inbound.relax(s, outbound.records[id].dist, NO_PARENT, {}, id);
       }
-    }
-  };
 
-  struct ParentInfo {
-    State parent;
-    Action action;
-  };
+      auto goal = inbound.run(space, maps, [&](const State &s) { return space.isGoal(s); },
+                              [](const State &, uint32_t) {});
+      if (!goal) return {};
 
-  // -------------------------------------------------------------------------------
-  static Monster calcFighterStats(const std::vector<EquippedItem> &equipped) {
-    Monster stats = {.hp = 10000, .off = 3, .def = 2, .stacking_off = 0, .stacking_def = 0,};
-    for (auto &eq: equipped) {
-      stats.hp += eq.hp;
-      stats.off += eq.off;
-      stats.def += eq.def;
-      stats.stacking_off += eq.stacking_off;
-      stats.stacking_def += eq.stacking_def;
-    }
-    if (stats.hp < 1) stats.hp = 1;
-    return stats;
-  }
+      // The inbound chain ends at a seed, whose source links it to the outbound chain.
+      size_t back = 0;
+      StateId seed = *goal;
+      for (; inbound.source[seed] == NO_PARENT; seed = inbound.records[seed].parent) back++;
+      StateId turn = inbound.source[seed];
 
-  // --------------------------------------------------------------------------------
-  struct StateHash {
-    std::size_t operator()(const State &s) const {
-      std::size_t h1 = std::hash<RoomId>{}(s.room);
-      std::size_t h2 = std::hash<bool>{}(s.hasTreasure);
-      std::size_t h3 = 0;
-      for (const auto &eq: s.equipped) {
-        h3 ^= (std::hash<int>{}(eq.off) << 1)
-            ^ (std::hash<int>{}(eq.def) << 2)
-            ^ (std::hash<int>{}(eq.hp) << 3)
-            ^ (std::hash<int>{}(eq.stacking_off) << 4)
-            ^ (std::hash<int>{}(eq.stacking_def) << 5)
-            ^ (std::hash<int>{}(eq.type) << 6)
-            ^ (std::hash<bool>{}(eq.first_attack) << 7)
-            ^ (std::hash<bool>{}(eq.stealth) << 8);
+      std::vector<Action> path(pathLength(outbound.records, turn) + back);
+      size_t i = path.size();
+      for (StateId current = *goal; current != seed; current = inbound.records[current].parent) {
+        path[--i] = inbound.records[current].action;
       }
-      std::size_t h4 = std::hash<bool>{}(s.usedStealth);
-
-      return h1 ^ (h2 << 1) ^ (h3 << 2) ^ (h4 << 3);
+      reconstructPath(outbound.records, turn, std::span(path).first(i));
+      return path;
     }
+
+  private:
+    LoadoutMaps maps;
+    SearchSpace space;
+    DialSearch<> outbound;
+    std::vector<uint32_t> arrivalStart;
+    std::vector<StateId> arrivals;
   };
 
-  std::vector<Action> reconstructPath(
-    const std::unordered_map<State, ParentInfo, StateHash> &parents,
-    State &current
+  // One path per treasure, each as short as find_shortest_path would return.
+  std::vector<std::vector<Action> > find_shortest_paths(
+    const Dungeon &dungeon,
+    const std::vector<RoomId> &entrances,
+    const std::vector<RoomId> &treasures,
+    CombatCache &combat
   ) {
-    std::vector<Action> path;
-    while (true) {
-      auto it = parents.find(current);
-      if (it == parents.end()) break;
-      const ParentInfo &pi = it->second;
-      if (pi.parent.room == SIZE_MAX) break; // Reached the initial state
-      path.push_back(pi.action);
-      current = pi.parent;
-    }
-    std::reverse(path.begin(), path.end());
-    return path;
-  }
-
-  // -------------------------------------------------------------------------------------------------
-  void print_path(const std::vector<Action> &path) {
-    std::cout << "Path (" << path.size() << " actions): ";
-    for (size_t i = 0; i < path.size(); ++i) {
-      if (i > 0) std::cout << " -> ";
-
-      if (auto m = std::get_if<Move>(&path[i])) {
-        std::cout << "Move(" << m->room << ")";
-      } else if (auto p = std::get_if<Pickup>(&path[i])) {
-        std::cout << "Pickup(" << p->item << ")";
-      } else if (auto d = std::get_if<Drop>(&path[i])) {
-        std::cout << "Drop(";
-        if (d->type == Item::Weapon) std::cout << "Weapon";
-        else if (d->type == Item::Armor) std::cout << "Armor";
-        else if (d->type == Item::RubberDuck) std::cout << "Duck";
-        std::cout << ")";
-      }
-    }
-    std::cout << std::endl;
+    BatchSolver solver(dungeon, entrances, combat);
+    std::vector<std::vector<Action> > paths;
+    paths.reserve(treasures.size());
+    for (auto treasure: treasures) paths.push_back(solver.solve(treasure));
+    return paths;
   }
 
-  std::vector<Action> find_shortest_path(
+  std::vector<std::vector<Action> > find_shortest_paths(
     const std::vector<Room> &rooms,
     const std::vector<RoomId> &entrances,
-    RoomId treasure
+    const std::vector<RoomId> &treasures
   ) {
-    std::deque<State> q;
-    std::unordered_set<State, StateHash> visited;
-    std::unordered_map<State, ParentInfo, StateHash> parents;
-    State OUT_STATE = {
-      .room = SIZE_MAX,
-      .hasTreasure = false,
-      .equipped = {},
-      .usedStealth = false,
-    };
+    CombatCache combat;
+    return find_shortest_paths(Dungeon(rooms), entrances, treasures, combat);
+  }
 
-    for (auto &en: entrances) {
-      State s = {
-        .room = en,
-        .hasTreasure = false,
-        .equipped = {},
-        .usedStealth = false,
-      };
-      q.push_back(s);
-      visited.insert(s);
-      parents[s] = {.parent = OUT_STATE, {Move{en}}};
+  // -------------------------------------------------------------------------------
+  // Keeps its search between edits of the rooms, for editors that re-solve after every change.
+  // An edit only changes moves into the edited room and moves and pickups inside it. A state
+  // the search reached before it first expanded a state in or next to that room therefore
+  // keeps its distance and route. solve() drops the states from that distance on and
+  // resumes from the level below, so an edit the search never came near costs nothing.
+  class IncrementalSolver {
+  public:
+    IncrementalSolver(std::vector<Room> rooms, std::vector<RoomId> entrances, RoomId treasure)
+      : rooms(std::move(rooms)), entrances(std::move(entrances)), dungeon(this->rooms),
+        space(dungeon, this->entrances, treasure, combat, {}), touched(this->rooms.size(), UNTOUCHED) {}
+
+    IncrementalSolver(const IncrementalSolver &) = delete;
+    IncrementalSolver &operator=(const IncrementalSolver &) = delete;
+
+    const std::vector<Room> &layout() const { return rooms; }
+
+    void addNeighbor(RoomId room, RoomId neighbor) {
+      rooms.at(room).neighbors.push_back(neighbor);
+      edited(room);
     }
 
+    void removeNeighbor(RoomId room, RoomId neighbor) {
+      std::erase(rooms.at(room).neighbors, neighbor);
+      edited(room);
+    }
 
-    while (!q.empty()) {
-      auto current = q.front();
-      q.pop_front();
-
-      const Room &room = rooms[current.room];
+    void setMonster(RoomId room, std::optional<Monster> monster) {
+      rooms.at(room).monster = monster;
+      edited(room);
+    }
 
-      if (room.monster.has_value()) {
-        bool hasStealth = current.hasStealth();
-        bool hasFirstAttack = current.hasFirstAttack();
+    void setItems(RoomId room, std::vector<Item> items) {
+      rooms.at(room).items = std::move(items);
+      edited(room);
+    }
 
+    // States the last solve() took over from the one before, all of them if nothing had to be redone.
+    size_t reusedStates() const { return reused; }
 
-        Monster heroObj = calcFighterStats(current.equipped);
-        auto combatResult = hasFirstAttack
-                              ? simulate_combat(heroObj, room.monster.value())
-                              : simulate_combat(room.monster.value(), heroObj);
-        bool survived = hasFirstAttack ? (combatResult == A_WINS) : (combatResult == B_WINS);
-        if (!survived) {
-          if (!hasStealth) {
-            visited.insert(current);
-            continue;
-          }
-          current.usedStealth = true;
-        }
+    std::vector<Action> solve() {
+      if (rebuild) {
+        // Known items keep their slots, the states kept still mean the same loadouts.
+        dungeon = Dungeon(rooms, dungeon.items());
+        maps.reset();
+        rebuild = false;
       }
+      if (!maps) maps.emplace(dungeon, combat);
+
+      if (redoFrom != UNTOUCHED) {
+        restart(redoFrom);
+        redoFrom = UNTOUCHED;
+        goal = search.run(space, *maps, [&](const State &s) { return space.isGoal(s); },
+                          [&](const State &s, uint32_t dist) {
+                            touched[s.room] = std::min(touched[s.room], dist);
+                            for (auto n: dungeon.neighborsOf(s.room)) touched[n] = std::min(touched[n], dist);
+                          });
+      } else {
+        reused = std::ranges::count_if(search.records, [](auto &r) { return r.dist != UNTOUCHED; });
+      }
+      return goal ? reconstructPath(search.records, *goal) : std::vector<Action>{};
+    }
 
+  private:
+    static constexpr uint32_t UNTOUCHED = std::numeric_limits<uint32_t>::max();
+
+    std::vector<Room> rooms;
+    std::vector<RoomId> entrances;
+    CombatCache combat;
+    Dungeon dungeon;
+    SearchSpace space;
+    std::optional<LoadoutMaps> maps;
+    DialSearch<> search;
+    std::vector<uint32_t> touched; // Lowest distance a state in or next to the room was expanded at
+    uint32_t redoFrom = 0; // Distance the search is stale from, UNTOUCHED if it is not
+    bool rebuild = false;
+    std::optional<StateId> goal;
+    size_t reused = 0;
+
+    void edited(RoomId room) {
+      redoFrom = std::min(redoFrom, touched[room]);
+      rebuild = true;
+    }
 
-      if (current.room == treasure && !current.usedStealth)
-        current.hasTreasure = true;
-
-      for (ItemId itemIndex = 0; itemIndex < room.items.size(); itemIndex++) {
-        const Item &item = room.items[itemIndex];
-        auto next = current;
-        auto it = std::ranges::find_if(next.equipped, [&](const EquippedItem &eq) {
-          return eq.type == item.type;
+    // Forgets the states at distance `from` and beyond, and queues the level below for expansion.
+    void restart(uint32_t from) {
+      reused = 0;
+      if (from == 0) {
+        search = DialSearch<>();
+        std::ranges::fill(touched, UNTOUCHED);
+        space.forEachStart(entrances, combat, [&](const State &s, const Action &action) {
+          search.relax(s, 0, NO_PARENT, action);
         });
-        bool haveThisType = it != next.equipped.end();
-        if (!haveThisType && !current.usedStealth) {
-          next.equipItem(item);
-          if (!visited.contains(next)) {
-            q.push_front(next);
-            parents[next] = {.parent = current, .action = Pickup{itemIndex}};
-            visited.insert(next);
-          }
-        } else if (haveThisType) {
-          auto temp = next;
-          temp.dropItem(room.items[itemIndex].type);
-          if (!visited.contains(temp)) {
-            q.push_front(temp);
-            parents[temp] = {.parent = current, .action = Drop{item.type}};
-            if (!current.usedStealth) {
-              auto temp2 = temp;
-              temp2.equipItem(room.items[itemIndex]);
-              if (!visited.contains(temp2)) {
-                q.push_front(temp2);
-                parents[temp2] = {.parent = temp, .action = Pickup{itemIndex}};
-              }
-            }
-          }
-        }
+        for (auto en: entrances) touched[en] = 0;
+        return;
       }
 
-      if (current.hasTreasure && std::ranges::find(entrances, current.room) != entrances.end()) {
-        auto path = reconstructPath(parents, current);
-        print_path(path);
-        return path;
+      search.buckets.clear();
+      search.buckets.resize(from);
+      for (StateId id = 0; id < search.records.size(); id++) {
+        uint32_t &dist = search.records[id].dist;
+        if (dist >= from) dist = UNTOUCHED; // Relaxed again if the search gets back to it
+        else reused++;
+        if (dist == from - 1) search.buckets[dist].emplace_back(search.states[id], id);
       }
-
-      for (auto &neighbour: room.neighbors) {
-        auto tba = current;
-        tba.room = neighbour;
-        tba.usedStealth = false;
-        if (!visited.contains(tba)) {
-          q.push_back(tba);
-          parents[tba] = {.parent = current, .action = Move{neighbour}};
-          visited.insert(tba);
-        }
+      search.level = from - 1;
+      search.position = 0;
+      for (auto &dist: touched) {
+        if (dist >= from) dist = UNTOUCHED;
       }
     }
-    return {};
-  }
+  };
 
 
 #ifndef __PROGTEST__
@@ -404,23 +2286,30 @@ bool contains(const auto &vec, const auto &x) {
   return std::ranges::find(vec, x) != vec.end();
 };
 
+// Action alternatives do not define operator==.
+bool same_path(const std::vector<Action> &a, const std::vector<Action> &b) {
+  return std::ranges::equal(a, b, [](const Action &x, const Action &y) {
+    if (x.index() != y.index()) return false;
+    if (auto m = std::get_if<Move>(&x)) return m->room == std::get<Move>(y).room;
+    if (auto p = std::get_if<Pickup>(&x)) return p->item == std::get<Pickup>(y).item;
+    return std::get<Drop>(x).type == std::get<Drop>(y).type;
+  });
+}
+
 #define CHECK(cond, ...) do { \
     if (!(cond)) { fprintf(stderr, __VA_ARGS__); assert(0); } \
   } while (0)
 
-void check_solution(
+void check_path(
   const std::vector<Room> &rooms,
   const std::vector<RoomId> &entrances,
-  RoomId treasure,
   size_t expected_rooms,
-  bool print = false
+  const std::vector<Action> &solution,
+  bool print
 ) {
   // TODO check if hero survives combat
   // TODO check if treasure was collected
 
-  using student_namespace::find_shortest_path;
-  const std::vector<Action> solution = find_shortest_path(rooms, entrances, treasure);
-
   if (expected_rooms == 0) {
     CHECK(solution.size() == 0, "No solution should exist but got some.\n");
     return;
@@ -478,6 +2367,49 @@ void check_solution(
   CHECK(room_count == expected_rooms,
         "Expected %zu rooms but got %zu.\n", expected_rooms, room_count);
 }
+
+// Checks the default solver and every optional search mode.
+void check_solution(
+  const std::vector<Room> &rooms,
+  const std::vector<RoomId> &entrances,
+  RoomId treasure,
+  size_t expected_rooms,
+  bool print = false
+) {
+  using namespace student_namespace;
+  auto serial = find_shortest_path(rooms, entrances, treasure);
+  check_path(rooms, entrances, expected_rooms, serial, print);
+
+  CombatCache combat;
+  check_path(rooms, entrances, expected_rooms,
+             find_shortest_path(rooms, entrances, treasure, combat, {.routePruning = true}), print);
+
+  auto levelSync = find_shortest_path(rooms, entrances, treasure, combat, {.threads = 1});
+  check_path(rooms, entrances, expected_rooms, levelSync, print);
+  CHECK(same_path(levelSync, serial), "Parallel search must return the serial search's path.\n");
+  CHECK(same_path(find_shortest_path(rooms, entrances, treasure, combat, {.threads = 4}), levelSync),
+        "Parallel search must return the same path for every thread count.\n");
+
+  check_path(rooms, entrances, expected_rooms, find_shortest_paths(rooms, entrances, {treasure})[0], print);
+  check_path(rooms, entrances, expected_rooms,
+             find_shortest_path(rooms, entrances, treasure, combat, {.memoryLimit = 1 << 20}), print);
+  check_path(rooms, entrances, expected_rooms, find_shortest_path(rooms, entrances, treasure, combat, {.astar = true}),
+             print);
+
+  // Into a caller's buffer: too small leaves it untouched and reports the size needed.
+  const Dungeon dungeon(rooms);
+  std::vector<Action> buffer(1, Pickup{.item = NO_ROOM});
+  size_t length = find_shortest_path(dungeon, entrances, treasure, combat, buffer);
+  auto expected = find_shortest_path(dungeon, entrances, treasure, combat);
+  CHECK(length == expected.size(), "Span overload must report the full path length.\n");
+  if (length > buffer.size()) {
+    CHECK(same_path(buffer, {Pickup{.item = NO_ROOM}}), "Too small a buffer must not be written.\n");
+    buffer.resize(length);
+    CHECK(find_shortest_path(dungeon, entrances, treasure, combat, buffer) == length, "Same query, same length.\n");
+  }
+  buffer.resize(length);
+  CHECK(same_path(buffer, expected), "Span overload must write the same path.\n");
+}
 #undef CHECK
 
 
@@ -865,7 +2797,693 @@ void example_tests6() {
   check_solution(rooms, {0}, LEN - 1, 2 * LEN - 1);
 }
 
-int main() {
+// The turn-by-turn loop turns_to_kill used to run.
+std::optional<int> turns_to_kill_reference(int hp, int dmg, int stacking_dmg) {
+  if (stacking_dmg == 0) {
+    if (dmg <= 0) return {};
+    return (hp + dmg - 1) / dmg;
+  }
+
+  int i = 0;
+  for (; hp > 0; i++) {
+    if (dmg <= 0 && stacking_dmg < 0) return {};
+    hp -= std::max(dmg, 0);
+    dmg += stacking_dmg;
+  }
+
+  return i;
+}
+
+void turns_to_kill_examples() {
+  using student_namespace::turns_to_kill;
+
+  assert(turns_to_kill(10, 5, 0) == 2);
+  assert(turns_to_kill(10, 0, 0) == std::nullopt);
+  assert(turns_to_kill(std::numeric_limits<int>::max(), 1, 0) == std::numeric_limits<int>::max());
+  assert(turns_to_kill(std::numeric_limits<int>::max(), std::numeric_limits<int>::max(), 0) == 1);
+  assert(turns_to_kill(10, 4, -2) == std::nullopt); // 4 + 2 only
+  assert(turns_to_kill(6, 4, -2) == 2);
+  assert(turns_to_kill(10, -3, 2) == 6); // 0 + 0 + 1 + 3 + 5 + 7
+  assert(turns_to_kill(10'000'000, 1, 1) == 4'472);
+  assert(turns_to_kill(2'000'000'000, -std::numeric_limits<int>::max(), 1) == std::numeric_limits<int>::max());
+  assert(turns_to_kill(std::numeric_limits<int>::max(), std::numeric_limits<int>::max(), -1) == 1);
+  assert(turns_to_kill(std::numeric_limits<int>::max(), 1, std::numeric_limits<int>::max()) == 2);
+
+  std::mt19937 rng(42);
+  auto uniform = [&](int lo, int hi) { return std::uniform_int_distribution<int>(lo, hi)(rng); };
+  for (int i = 0; i < 200'000; i++) {
+    int hp = uniform(1, i % 2 ? 100 : 100'000);
+    int dmg = uniform(-1'000, 1'000);
+    int stacking = uniform(-50, 50);
+    auto expected = turns_to_kill_reference(hp, dmg, stacking);
+    auto got = turns_to_kill(hp, dmg, stacking);
+    if (got != expected) {
+      fprintf(stderr, "turns_to_kill(%d, %d, %d) = %d, expected %d\n", hp, dmg, stacking,
+              got.value_or(-1), expected.value_or(-1));
+      assert(0);
+    }
+  }
+}
+
+void dominance_examples() {
+  const Item sword = {.name = "Sword", .type = Item::Weapon, .off = 5, .def = -1};
+  const Item better_sword = {.name = "Better Sword", .type = Item::Weapon, .off = 6, .def = -1};
+  const Item fast_sword = {.name = "Fast Sword", .type = Item::Weapon, .off = 1, .first_attack = true};
+  const Item armor = {.name = "Armor", .type = Item::Armor, .off = -1, .def = 1};
+
+  std::vector<Room> rooms(3);
+  rooms[0].items = {sword, sword, sword};
+  rooms[1].items = {sword, fast_sword, armor, better_sword};
+  rooms[2].items = {armor};
+
+  student_namespace::ItemTable table(rooms);
+  assert(table.dominatedItems == 3);
+  assert((table.pickups[0] == std::vector<ItemId>{0}));
+  assert((table.pickups[1] == std::vector<ItemId>{1, 2, 3}));
+  assert((table.pickups[2] == std::vector<ItemId>{0}));
+}
+
+// Big enough layers to actually split the work between threads.
+void parallel_examples() {
+  using namespace student_namespace;
+  constexpr size_t SIDE = 40;
+  std::vector<Room> rooms(SIDE * SIDE);
+  std::mt19937 rng(7);
+
+  for (size_t r = 0; r < SIDE; r++) {
+    for (size_t c = 0; c < SIDE; c++) {
+      Room &room = rooms[r * SIDE + c];
+      if (r + 1 < SIDE) room.neighbors.push_back((r + 1) * SIDE + c);
+      if (r > 0) room.neighbors.push_back((r - 1) * SIDE + c);
+      if (c + 1 < SIDE) room.neighbors.push_back(r * SIDE + c + 1);
+      if (c > 0) room.neighbors.push_back(r * SIDE + c - 1);
+      if (rng() % 3 == 0) room.items.push_back({.name = "Sword", .type = Item::Weapon, .off = 5 * int(rng() % 4)});
+      if (rng() % 4 == 0) room.items.push_back({.name = "Armor", .type = Item::Armor, .def = 5 * int(rng() % 4)});
+      if (rng() % 5 == 0) room.monster = Monster{.hp = 5'000 + int(rng() % 5'000), .off = 4, .def = int(rng() % 8)};
+    }
+  }
+  rooms[SIDE * SIDE - 1].monster = Monster{.hp = 30'000, .off = 10, .def = 2};
+
+  CombatCache combat;
+  auto serial = find_shortest_path(rooms, {0}, SIDE * SIDE - 1, combat);
+  auto one = find_shortest_path(rooms, {0}, SIDE * SIDE - 1, combat, {.threads = 1});
+  auto many = find_shortest_path(rooms, {0}, SIDE * SIDE - 1, combat, {.threads = 8});
+  auto moves = [](const std::vector<Action> &path) {
+    return std::ranges::count_if(path, [](const Action &a) { return std::holds_alternative<Move>(a); });
+  };
+  assert(!serial.empty());
+  assert(moves(one) == moves(serial));
+  assert(same_path(one, serial) && same_path(one, many));
+}
+
+// SIDE x SIDE grid with random swords, stealth cloaks, first attack ducks and monsters.
+std::vector<Room> random_grid(size_t SIDE, unsigned seed) {
+  std::vector<Room> rooms(SIDE * SIDE);
+  std::mt19937 rng(seed);
+
+  for (size_t r = 0; r < SIDE; r++) {
+    for (size_t c = 0; c < SIDE; c++) {
+      Room &room = rooms[r * SIDE + c];
+      if (r + 1 < SIDE) room.neighbors.push_back((r + 1) * SIDE + c);
+      if (r > 0) room.neighbors.push_back((r - 1) * SIDE + c);
+      if (c + 1 < SIDE) room.neighbors.push_back(r * SIDE + c + 1);
+      if (c > 0) room.neighbors.push_back(r * SIDE + c - 1);
+      if (rng() % 4 == 0) room.items.push_back({.name = "Sword", .type = Item::Weapon, .off = int(rng() % 20)});
+      if (rng() % 9 == 0) room.items.push_back({.name = "Cloak", .type = Item::Armor, .stealth = true});
+      if (rng() % 9 == 0) room.items.push_back({.name = "Fast Duck", .type = Item::RubberDuck, .first_attack = true});
+      if (rng() % 4 == 0) room.monster = Monster{.hp = 5'000 + int(rng() % 10'000), .off = 5, .def = int(rng() % 15)};
+    }
+  }
+  return rooms;
+}
+
+size_t count_moves(const std::vector<Action> &path) {
+  return std::ranges::count_if(path, [](const Action &a) { return std::holds_alternative<Move>(a); });
+}
+
+// Knobs of random_dungeon. Densities are expected counts per room, frequencies are probabilities.
+struct DungeonShape {
+  size_t rooms = 1000;
+  double degree = 3; // Average number of neighbours, at least 2 (the rooms are joined in a random tree first)
+  double itemDensity = 0.3;
+  double monsterDensity = 0.2;
+  double stealthFrequency = 0.05; // Of the items generated
+  int itemVariants = 4; // Distinct items per type, dungeons reuse them like the examples do
+};
+
+// A random connected dungeon with two-way passages, the same for the same shape and seed.
+// Monsters range from pushovers to ones only strong items or stealth get past.
+std::vector<Room> random_dungeon(const DungeonShape &shape, unsigned seed) {
+  std::vector<Room> rooms(shape.rooms);
+  std::mt19937 rng(seed);
+  auto chance = [&](double p) { return std::uniform_real_distribution<double>(0, 1)(rng) < p; };
+  auto stat = [&](int lo, int hi) { return std::uniform_int_distribution<int>(lo, hi)(rng); };
+  auto connect = [&](RoomId a, RoomId b) {
+    rooms[a].neighbors.push_back(b);
+    rooms[b].neighbors.push_back(a);
+  };
+
+  for (RoomId r = 1; r < rooms.size(); r++) connect(r, rng() % r);
+  size_t extra = shape.degree > 2 ? size_t((shape.degree - 2) * double(rooms.size()) / 2) : 0;
+  for (size_t e = 0; e < extra && rooms.size() > 1; e++) {
+    RoomId a = rng() % rooms.size(), b = rng() % rooms.size();
+    if (a != b) connect(a, b);
+  }
+
+  std::vector<Item> variants;
+  for (int v = 0; v < Item::TYPE_COUNT * shape.itemVariants; v++) {
+    Item item = {.name = "Item " + std::to_string(v), .type = Item::Type(v % Item::TYPE_COUNT)};
+    item.hp = stat(-500, 2'000);
+    item.off = stat(-2, 12);
+    item.def = stat(-2, 10);
+    if (chance(0.2)) item.stacking_off = stat(-1, 2);
+    if (chance(0.2)) item.stacking_def = stat(-1, 2);
+    item.first_attack = chance(0.1);
+    item.stealth = chance(shape.stealthFrequency);
+    variants.push_back(item);
+  }
+
+  std::poisson_distribution<int> items(shape.itemDensity);
+  for (auto &room: rooms) {
+    for (int i = items(rng); i > 0 && !variants.empty(); i--) room.items.push_back(variants[rng() % variants.size()]);
+    if (chance(shape.monsterDensity)) {
+      room.monster = Monster{.hp = stat(50, 20'000), .off = stat(1, 400), .def = stat(0, 15)};
+    }
+  }
+  return rooms;
+}
+
+void random_dungeon_examples() {
+  using namespace student_namespace;
+  DungeonShape shape = {.rooms = 200, .degree = 3.5, .itemDensity = 0.5, .monsterDensity = 0.3};
+  auto rooms = random_dungeon(shape, 5);
+  auto again = random_dungeon(shape, 5);
+  for (RoomId r = 0; r < rooms.size(); r++) {
+    assert(rooms[r].neighbors == again[r].neighbors && rooms[r].items == again[r].items);
+  }
+  assert(std::ranges::all_of(reachableRooms(rooms.size(), {0}, [&](RoomId r) -> auto & { return rooms[r].neighbors; }),
+                             std::identity{}));
+
+  for (unsigned seed = 0; seed < 4; seed++) {
+    rooms = random_dungeon(shape, seed);
+    CombatCache combat;
+    size_t moves = count_moves(find_shortest_path(rooms, {0, 1}, 100, combat));
+    check_path(rooms, {0, 1}, moves, find_shortest_path(rooms, {0, 1}, 100, combat, {.astar = true}), false);
+    check_path(rooms, {0, 1}, moves, find_shortest_path(rooms, {0, 1}, 100, combat, {.routePruning = true}), false);
+  }
+}
+
+void dungeon_file_examples() {
+  using namespace student_namespace;
+  constexpr size_t SIDE = 12;
+  auto rooms = random_grid(SIDE, 11);
+
+  auto path = (std::filesystem::temp_directory_path() / "pt1_dungeon_file_examples.bin").string();
+  write_dungeon_file(path, rooms, {0, SIDE - 1}, SIDE * SIDE - 1);
+  auto file = map_dungeon_file(path);
+  assert(file.dungeon.roomCount == rooms.size());
+  assert(file.entrances == std::vector<RoomId>({0, SIDE - 1}));
+  assert(file.treasure == SIDE * SIDE - 1);
+
+  CombatCache combat;
+  for (RoomId treasure = 0; treasure < rooms.size(); treasure += 7) {
+    auto expected = find_shortest_path(rooms, file.entrances, treasure, combat);
+    assert(same_path(find_shortest_path(file.dungeon, file.entrances, treasure, combat), expected));
+  }
+
+  bool thrown = false;
+  try { write_dungeon_file(path, rooms, {0, rooms.size()}, 0); }
+  catch (const std::invalid_argument &) { thrown = true; }
+  assert(thrown);
+
+  // Corrupt files, each with one offset or id out of range.
+  auto rejected = [&](auto &&corrupt, std::vector<RoomId> entrances, uint32_t treasure) {
+    DungeonArrays arrays(rooms);
+    corrupt(arrays);
+    auto image = encodeDungeon(arrays, rooms.size(), entrances, treasure);
+    std::ofstream(path, std::ios::binary | std::ios::trunc)
+      .write(reinterpret_cast<const char *>(image.data()), std::streamsize(image.size() * sizeof(uint64_t)));
+    try { map_dungeon_file(path); } catch (const std::runtime_error &) { return true; }
+    return false;
+  };
+  auto intact = [](DungeonArrays &) {};
+  assert(!rejected(intact, {0}, 0));
+  assert(rejected(intact, {0, rooms.size()}, 0));
+  assert(rejected(intact, {0}, uint32_t(rooms.size())));
+  assert(rejected([](DungeonArrays &a) { a.neighbors[3] = uint32_t(a.monsterOf.size()); }, {0}, 0));
+  assert(rejected([](DungeonArrays &a) { std::swap(a.neighborStart[1], a.neighborStart[2]); }, {0}, 0));
+  assert(rejected([](DungeonArrays &a) { a.pickupStart.back()--; }, {0}, 0));
+  assert(rejected([](DungeonArrays &a) { a.pickupSlot[0] = uint32_t(a.itemType.size()); }, {0}, 0));
+  assert(rejected([](DungeonArrays &a) { a.itemType[0] = Item::TYPE_COUNT; }, {0}, 0));
+  assert(rejected([](DungeonArrays &a) {
+    *std::ranges::find(a.monsterOf, Dungeon::NO_MONSTER) = uint32_t(a.monsters.hp.size());
+  }, {0}, 0));
+
+  write_dungeon_file(path, rooms, {0}, NO_ROOM);
+  assert(map_dungeon_file(path).treasure == NO_ROOM);
+
+  std::filesystem::resize_file(path, std::filesystem::file_size(path) - 8);
+  thrown = false;
+  try { map_dungeon_file(path); } catch (const std::runtime_error &) { thrown = true; }
+  assert(thrown);
+
+  std::ofstream(path, std::ios::binary | std::ios::trunc) << std::string(1024, 'x');
+  thrown = false;
+  try { map_dungeon_file(path); } catch (const std::runtime_error &) { thrown = true; }
+  assert(thrown);
+
+  std::filesystem::remove(path);
+  thrown = false;
+  try { map_dungeon_file(path); } catch (const std::runtime_error &) { thrown = true; }
+  assert(thrown);
+}
+
+void batch_examples() {
+  using namespace student_namespace;
+
+  for (unsigned seed = 1; seed <= 3; seed++) {
+    auto rooms = random_grid(10, seed);
+    std::vector<RoomId> entrances = {0, 9, 55}, treasures;
+    for (RoomId t = 0; t < rooms.size(); t++) treasures.push_back(t);
+
+    auto paths = find_shortest_paths(rooms, entrances, treasures);
+    assert(paths.size() == treasures.size());
+    for (RoomId t: treasures) {
+      size_t expected = count_moves(find_shortest_path(rooms, entrances, t));
+      assert(count_moves(paths[t]) == expected);
+      check_path(rooms, entrances, expected, paths[t], false);
+    }
+  }
+}
+
+void incremental_examples() {
+  using namespace student_namespace;
+  constexpr size_t SIDE = 12;
+  const std::vector<RoomId> entrances = {0};
+  const RoomId treasure = SIDE * SIDE - 1;
+  IncrementalSolver solver(random_grid(SIDE, 5), entrances, treasure);
+  auto scratch = [&] { return count_moves(find_shortest_path(solver.layout(), entrances, treasure)); };
+  assert(count_moves(solver.solve()) == scratch());
+
+  std::mt19937 rng(3);
+  for (int edit = 0; edit < 80; edit++) {
+    RoomId room = rng() % (SIDE * SIDE);
+    switch (rng() % 4) {
+      case 0:
+        if (rng() % 2) solver.setMonster(room, std::nullopt);
+        else solver.setMonster(room, Monster{.hp = 1'000 + int(rng() % 20'000), .off = 5, .def = int(rng() % 15)});
+        break;
+      case 1:
+        solver.setItems(room, {{.name = "Sword", .type = Item::Weapon, .off = int(rng() % 30)}});
+        break;
+      case 2:
+        solver.addNeighbor(room, rng() % (SIDE * SIDE));
+        break;
+      default:
+        if (!solver.layout()[room].neighbors.empty()) solver.removeNeighbor(room, solver.layout()[room].neighbors[0]);
+    }
+    auto path = solver.solve();
+    size_t expected = scratch();
+    assert(count_moves(path) == expected);
+    check_path(solver.layout(), entrances, expected, path, false);
+  }
+
+  // The search never gets near the far end of a long corridor, edits there keep everything.
+  constexpr size_t LEN = 60;
+  std::vector<Room> corridor(LEN);
+  for (size_t i = 1; i < LEN; i++) {
+    corridor[i - 1].neighbors.push_back(i);
+    corridor[i].neighbors.push_back(i - 1);
+  }
+  IncrementalSolver local(corridor, {0}, 5);
+  auto path = local.solve();
+  assert(count_moves(path) == 11);
+  local.setMonster(50, Monster{.hp = 1'000'000, .off = 1'000'000});
+  assert(same_path(local.solve(), path));
+  size_t all = local.reusedStates();
+  assert(all > 0);
+
+  local.setMonster(3, Monster{.hp = 1, .off = 1});
+  assert(count_moves(local.solve()) == 11);
+  assert(local.reusedStates() > 0 && local.reusedStates() < all);
+  local.setMonster(3, Monster{.hp = 1'000'000, .off = 1'000'000});
+  assert(local.solve().empty());
+}
+
+void astar_examples() {
+  using namespace student_namespace;
+  for (unsigned seed = 1; seed <= 5; seed++) {
+    auto rooms = random_grid(20, seed);
+    const RoomId treasure = 20 * 10 + 10;
+
+    CombatCache combat;
+    SearchStats bfs, astar;
+    size_t expected = count_moves(find_shortest_path(rooms, {0}, treasure, combat, {.stats = &bfs}));
+    auto path = find_shortest_path(rooms, {0}, treasure, combat, {.astar = true, .stats = &astar});
+    check_path(rooms, {0}, expected, path, false);
+    assert(astar.statesExpanded <= bfs.statesExpanded);
+  }
+}
+
+void bounded_memory_examples() {
+  using namespace student_namespace;
+  auto rooms = random_grid(10, 2);
+  const RoomId treasure = 99;
+
+  CombatCache combat;
+  SearchStats unbounded, bounded;
+  size_t expected = count_moves(find_shortest_path(rooms, {0}, treasure, combat, {.stats = &unbounded}));
+  assert(expected > 0);
+
+  // A table far too small for the state space still gives a nearest route.
+  constexpr size_t LIMIT = 16 << 10;
+  auto path = find_shortest_path(rooms, {0}, treasure, combat, {.memoryLimit = LIMIT, .stats = &bounded});
+  check_path(rooms, {0}, expected, path, false);
+  assert(bounded.peakMemory <= LIMIT && bounded.peakMemory < unbounded.peakMemory);
+
+  // Not even the tables kept per room fit.
+  bool thrown = false;
+  try { find_shortest_path(rooms, {0}, treasure, combat, {.memoryLimit = 256}); }
+  catch (const std::invalid_argument &) { thrown = true; }
+  assert(thrown);
+
+  // The first entrance leads only into a loop and a guard no one gets past, the way in from
+  // the second is too long for the first limits. The loop's states all fit in the table,
+  // which must not end the search while that entrance is still cut off.
+  std::vector<Room> trap(16);
+  auto link = [&](RoomId a, RoomId b) {
+    trap[a].neighbors.push_back(b);
+    trap[b].neighbors.push_back(a);
+  };
+  link(0, 1);
+  link(1, 2);
+  link(2, 0);
+  link(0, 3);
+  link(3, 4);
+  trap[3].monster = Monster{.hp = 1'000'000, .off = 1'000'000};
+  for (RoomId r = 5; r < 15; r++) link(r, r + 1);
+  link(15, 4);
+  check_solution(trap, {0, 5}, 4, 23);
+
+  // Only the axe beats the treasure's guard, and the axe lies behind a monster no one gets
+  // past. The table is too small for the states the rest of the dungeon has, so only the
+  // sweep can tell the treasure is out of reach.
+  std::vector<Room> locked(13);
+  auto connect = [&](RoomId a, RoomId b) {
+    locked[a].neighbors.push_back(b);
+    locked[b].neighbors.push_back(a);
+  };
+  for (RoomId r = 0; r < 12; r++) {
+    if (r != 1) connect(r, r + 1);
+  }
+  connect(0, 12);
+  connect(1, 3);
+  connect(4, 9);
+  locked[1].monster = Monster{.hp = 1'000'000, .off = 1'000'000};
+  locked[1].items = {{.name = "Axe", .type = Item::Weapon, .off = 1'000, .def = -1}};
+  locked[2].monster = Monster{.hp = 50'000, .off = 102};
+  locked[3].items = {{.name = "Shield", .type = Item::Armor, .def = 1}};
+  locked[4].items = {{.name = "Sword", .type = Item::Weapon, .off = 3}};
+  locked[5].items = {{.name = "Mace", .type = Item::Weapon, .off = 4}};
+  locked[7].items = {{.name = "Mail", .type = Item::Armor, .def = 2}};
+  locked[9].items = {{.name = "Duck", .type = Item::RubberDuck, .def = 1}};
+  locked[10].items = {{.name = "Duck", .type = Item::RubberDuck, .hp = 1}};
+  locked[11].items = locked[7].items;
+  locked[12].items = {{.name = "Club", .type = Item::Weapon, .off = 2}};
+  assert(find_shortest_path(locked, {0, 6}, 2, combat).empty());
+  assert(find_shortest_path(locked, {0, 6}, 2, combat, {.memoryLimit = 12 << 10}).empty());
+}
+
+// Both batched overloads must agree with simulate_combat fight by fight.
+void batch_combat_examples() {
+  using namespace student_namespace;
+  std::mt19937 rng(7);
+  auto stat = [&](int lo, int hi) { return std::uniform_int_distribution<int>(lo, hi)(rng); };
+  auto fighter = [&] {
+    bool stacking = rng() % 3 == 0;
+    return Monster{.hp = stat(1, 500), .off = stat(-5, 40), .def = stat(-5, 30),
+                   .stacking_off = stacking ? stat(-3, 3) : 0, .stacking_def = stacking ? stat(-3, 3) : 0};
+  };
+  auto heroWins = [](const Monster &hero, bool heroFirst, const Monster &monster) {
+    return heroFirst ? simulate_combat(hero, monster) == A_WINS : simulate_combat(monster, hero) == B_WINS;
+  };
+
+  constexpr size_t COUNT = 2000;
+  StatArrays fighters;
+  std::vector<uint8_t> first(COUNT), wins(COUNT);
+  for (size_t i = 0; i < COUNT; i++) {
+    fighters.push_back(fighter());
+    first[i] = rng() % 2;
+  }
+
+  for (int round = 0; round < 20; round++) {
+    Monster one = fighter();
+    bool oneFirst = round % 2;
+    simulate_combat(one, oneFirst, fighters.columns(), wins);
+    for (size_t i = 0; i < COUNT; i++) assert(bool(wins[i]) == heroWins(one, oneFirst, fighters.columns().at(i)));
+
+    simulate_combat(fighters.columns(), first, one, wins);
+    for (size_t i = 0; i < COUNT; i++) assert(bool(wins[i]) == heroWins(fighters.columns().at(i), first[i], one));
+  }
+}
+
+void combat_cache_examples() {
+  const Item sword = {
+    .name = "Sword", .type = Item::Weapon,
+    .off = 5, .def = -1,
+  };
+
+  constexpr int LEN = 50;
+  std::vector<Room> rooms(LEN);
+
+  for (int i = 1; i < LEN; i++) {
+    rooms[i - 1].neighbors.push_back(i);
+    rooms[i].neighbors.push_back(i - 1);
+    rooms[i].items = {sword};
+    rooms[i].monster = Monster{.hp = 100, .off = 5};
+  }
+
+  student_namespace::CombatCache cache;
+  auto path = student_namespace::find_shortest_path(rooms, {0}, LEN - 1, cache);
+  assert(path.size() == 2 * LEN - 1);
+  assert(cache.misses == 2); // One fight with and one without the sword
+  assert(cache.hits > 0);
+
+  size_t misses = cache.misses;
+  student_namespace::find_shortest_path(rooms, {0}, LEN / 2, cache);
+  assert(cache.misses == misses); // Same fights, answered from the cache
+
+  // The treasure is next to the entrance, the monsters behind it are never walked up to
+  // and so never fought.
+  std::vector<Room> lair(3);
+  auto link = [&](RoomId a, RoomId b) {
+    lair[a].neighbors.push_back(b);
+    lair[b].neighbors.push_back(a);
+  };
+  link(0, 1);
+  link(1, 2);
+  for (int i = 0; i < LEN; i++) {
+    lair.push_back({.neighbors = {}, .monster = Monster{.hp = 100 + i, .off = 5}, .items = {}});
+    link(2, lair.size() - 1);
+  }
+  student_namespace::CombatCache fresh;
+  assert(student_namespace::find_shortest_path(lair, {0}, 1, fresh).size() == 3);
+  assert(fresh.hits + fresh.misses == 0);
+}
+
+void stats_examples() {
+  using namespace student_namespace;
+  const Item sword = {.name = "Sword", .type = Item::Weapon, .off = 5, .def = -1};
+
+  constexpr int LEN = 300;
+  std::vector<Room> rooms(LEN);
+  for (int i = 1; i < LEN; i++) {
+    rooms[i - 1].neighbors.push_back(i);
+    rooms[i].neighbors.push_back(i - 1);
+    rooms[i].items = {sword, sword, sword};
+  }
+  rooms[LEN - 1].monster = Monster{.hp = 1'000'000, .off = 1'000'000};
+
+  CombatCache combat;
+  SearchStats stats;
+  size_t traced = 0;
+  SearchOptions options = {.stats = &stats, .trace = [&](const State &, uint32_t) { traced++; }};
+
+  assert(find_shortest_path(rooms, {0}, LEN - 1, combat, options).empty());
+  assert(stats.statesExpanded > 0 && traced == stats.statesExpanded);
+  assert(stats.statesDiscovered >= stats.statesExpanded);
+  assert(stats.peakFrontier > 0);
+  assert(stats.dominatedItems == 2 * (LEN - 1));
+  assert(stats.combatSimulations <= stats.combatLookups && stats.combatLookups > 0);
+  assert(stats.loadoutMaps == 2); // Bare hands and the sword, shared by every room
+
+  // The guard of the treasure beats every loadout, route pruning never starts searching.
+  options.routePruning = true;
+  assert(find_shortest_path(rooms, {0}, LEN - 1, combat, options).empty());
+  assert(stats.statesExpanded == 0);
+}
+
+// Hash quality benchmark, run as `pt1 bench-hash`.
+// Fills the solver's state set with every (room, loadout, flags) combination of
+// example_tests5/6 style corridors and reports how well each hash spreads them.
+using student_namespace::State;
+using student_namespace::ItemTable;
+using student_namespace::NO_ITEM;
+
+// The hash used while State stored a std::vector<EquippedItem>.
+struct LegacyStateHash {
+  const ItemTable *table;
+
+  size_t operator()(const State &s) const {
+    size_t h3 = 0;
+    for (auto slot: s.slots) {
+      if (slot == NO_ITEM) continue;
+      const auto &eq = table->items[slot];
+      h3 ^= (std::hash<int>{}(eq.off) << 1)
+          ^ (std::hash<int>{}(eq.def) << 2)
+          ^ (std::hash<int>{}(eq.hp) << 3)
+          ^ (std::hash<int>{}(eq.stacking_off) << 4)
+          ^ (std::hash<int>{}(eq.stacking_def) << 5)
+          ^ (std::hash<int>{}(eq.type) << 6)
+          ^ (std::hash<bool>{}(eq.first_attack) << 7)
+          ^ (std::hash<bool>{}(eq.stealth) << 8);
+    }
+    return std::hash<size_t>{}(s.room) ^ (size_t(s.hasTreasure) << 1) ^ (h3 << 2) ^ (size_t(s.usedStealth) << 3);
+  }
+};
+
+std::vector<Room> hash_bench_corridor(size_t len, int variants, bool monsters) {
+  std::vector<Room> rooms(len);
+  for (size_t i = 1; i < len; i++) {
+    rooms[i - 1].neighbors.push_back(i);
+    rooms[i].neighbors.push_back(i - 1);
+    int v = int(i % variants);
+    rooms[i].items = {
+      {.name = "Sword", .type = Item::Weapon, .off = 5 + v, .def = -1},
+      {.name = "Armor", .type = Item::Armor, .off = -v, .def = v},
+      {.name = "Defensive Duck", .type = Item::RubberDuck, .off = -100, .def = 100 + v},
+    };
+    if (monsters && i % 2) rooms[i].monster = Monster{.hp = 10'000'000, .off = 50, .def = -120};
+  }
+  return rooms;
+}
+
+std::vector<State> hash_bench_states(const std::vector<Room> &rooms, const ItemTable &table) {
+  std::array<std::vector<student_namespace::ItemSlot>, Item::TYPE_COUNT> byType;
+  for (auto &slots: byType) slots.push_back(NO_ITEM);
+  for (size_t i = 0; i < table.items.size(); i++) byType[table.items[i].type].push_back(i);
+
+  std::vector<State> states;
+  for (uint32_t room = 0; room < rooms.size(); room++)
+    for (auto w: byType[Item::Weapon])
+      for (auto a: byType[Item::Armor])
+        for (auto d: byType[Item::RubberDuck])
+          for (int flags = 0; flags < 4; flags++)
+            states.push_back({room, {w, a, d}, bool(flags & 1), bool(flags & 2)});
+  return states;
+}
+
+template<typename Hash>
+void report_hash(const char *name, const std::vector<State> &states, Hash hash) {
+  std::unordered_set<State, Hash> set(0, hash);
+  set.reserve(states.size());
+  for (auto &s: states) set.insert(s);
+
+  std::unordered_set<size_t> values;
+  for (auto &s: states) values.insert(hash(s));
+
+  size_t used = 0, longest = 0;
+  double probes = 0;
+  for (size_t b = 0; b < set.bucket_count(); b++) {
+    size_t n = set.bucket_size(b);
+    if (!n) continue;
+    used++;
+    longest = std::max(longest, n);
+    probes += n * (n + 1) / 2.0;
+  }
+
+  printf("  %-8s %zu states, %zu hash collisions, %zu/%zu buckets used, longest chain %zu, avg probes %.3f\n",
+         name, states.size(), states.size() - values.size(), used, set.bucket_count(), longest,
+         probes / states.size());
+}
+
+void hash_benchmark() {
+  struct { const char *name; std::vector<Room> rooms; } dungeons[] = {
+    {"example_tests5-style", hash_bench_corridor(300, 3, false)},
+    {"example_tests6-style", hash_bench_corridor(72, 6, true)},
+  };
+
+  for (auto &[name, rooms]: dungeons) {
+    ItemTable table(rooms);
+    auto states = hash_bench_states(rooms, table);
+    printf("%s:\n", name);
+    report_hash("legacy", states, LegacyStateHash{&table});
+    report_hash("mix64", states, student_namespace::StateHash{});
+  }
+}
+
+// Solver scaling benchmark, run as `pt1 bench [file]`.
+// Solves random_dungeon instances of growing size in every search mode and writes one
+// JSON object per run (JSON Lines) to `file`, or to stdout, so results can be diffed
+// and plotted across versions.
+void solver_benchmark(std::ostream &out) {
+  using namespace student_namespace;
+  constexpr unsigned SEEDS = 3;
+  struct { const char *name; SearchOptions options; } modes[] = {
+    {"bfs", {}},
+    {"pruned", {.routePruning = true}},
+    {"threads4", {.threads = 4}},
+    {"astar", {.astar = true}},
+  };
+
+  for (size_t size: {1'000, 4'000, 16'000, 64'000}) {
+    for (double degree: {2.5, 4.0}) {
+      for (unsigned seed = 1; seed <= SEEDS; seed++) {
+        DungeonShape shape = {.rooms = size, .degree = degree};
+        auto rooms = random_dungeon(shape, seed);
+        for (auto &[name, options]: modes) {
+          CombatCache combat;
+          SearchStats stats;
+          SearchOptions run = options;
+          run.stats = &stats;
+          auto started = std::chrono::steady_clock::now();
+          auto path = find_shortest_path(rooms, {0}, size / 2, combat, run);
+          std::chrono::duration<double> wall = std::chrono::steady_clock::now() - started;
+
+          out << "{\"rooms\":" << size << ",\"degree\":" << degree << ",\"items\":" << shape.itemDensity
+              << ",\"monsters\":" << shape.monsterDensity << ",\"stealth\":" << shape.stealthFrequency << ",\"variants\":" << shape.itemVariants
+              << ",\"seed\":" << seed << ",\"mode\":\"" << name << "\",\"moves\":" << count_moves(path)
+              << ",\"wall_s\":" << wall.count() << ",\"states_expanded\":" << stats.statesExpanded
+              << ",\"states_discovered\":" << stats.statesDiscovered << ",\"peak_bytes\":" << stats.peakMemory
+              << "}" << std::endl;
+        }
+      }
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1 && std::string(argv[1]) == "bench-hash") {
+    hash_benchmark();
+    return 0;
+  }
+  if (argc > 1 && std::string(argv[1]) == "bench") {
+    if (argc > 2) {
+      std::ofstream out(argv[2], std::ios::trunc);
+      solver_benchmark(out);
+      return !out;
+    }
+    solver_benchmark(std::cout);
+    return 0;
+  }
+  if (argc > 2 && std::string(argv[1]) == "solve") {
+    auto file = student_namespace::map_dungeon_file(argv[2]);
+    student_namespace::CombatCache combat;
+    auto path = student_namespace::find_shortest_path(file.dungeon, file.entrances, file.treasure, combat, {.printPath = true});
+    return path.empty();
+  }
+
+  turns_to_kill_examples();
   combat_examples();
   stealth_examples();
   example_tests();
@@ -873,6 +3491,18 @@ int main() {
   example_tests3();
   example_tests4();
   example_tests5();
+  example_tests6();
+  dominance_examples();
+  parallel_examples();
+  batch_combat_examples();
+  combat_cache_examples();
+  stats_examples();
+  random_dungeon_examples();
+  dungeon_file_examples();
+  batch_examples();
+  incremental_examples();
+  bounded_memory_examples();
+  astar_examples();
 }
 
 #endif
@@ -20,6 +20,11 @@
 #include <random>
 #include <type_traits>
 #include <utility>
+#include <compare>
+#include <iterator>
+#include <ranges>
+#include <map>
+#include <string>
 
 struct Hobbit {
   std::string name;
@@ -55,48 +60,175 @@ private:
     int def_diff = 0;
   };
 
+  // A name for comparisons: its first 8 bytes packed big-endian into an integer (zero padded)
+  // and the string itself. Names that differ early are ordered by one integer compare that
+  // never reads the characters, only names sharing 8 bytes compare the rest.
+  struct NameKey {
+    uint64_t prefix;
+    const std::string *name;
+
+    explicit NameKey(const std::string &name) : prefix(prefixOf(name)), name(&name) {}
+    NameKey(uint64_t prefix, const std::string &name) : prefix(prefix), name(&name) {}
+
+    static uint64_t prefixOf(const std::string &name) {
+      uint64_t prefix = 0;
+      for (size_t i = 0; i < 8; i++) prefix = prefix << 8 | (i < name.size() ? uint8_t(name[i]) : 0);
+      return prefix;
+    }
+
+    // Same order as std::string, which compares chars as unsigned.
+    friend std::strong_ordering operator<=>(const NameKey &a, const NameKey &b) {
+      if (a.prefix != b.prefix) return a.prefix <=> b.prefix;
+      size_t aSize = a.name->size(), bSize = b.name->size();
+      // With equal prefixes a name of at most 8 bytes is the start of the other one
+      if (aSize <= 8 || bSize <= 8) return aSize <=> bSize;
+      return a.name->compare(8, std::string::npos, *b.name, 8, std::string::npos) <=> 0;
+    }
+
+    friend bool operator==(const NameKey &a, const NameKey &b) { return (a <=> b) == 0; }
+  };
+
+  // Nodes live in one arena and point at each other by 32-bit index, NIL for none.
+  using NodeId = uint32_t;
+  static constexpr NodeId NIL = std::numeric_limits<NodeId>::max();
+
   struct Node {
     mutable Hobbit hobbit;
-    Node *left = nullptr, *right = nullptr;
+    uint64_t prefix; // NameKey::prefixOf(hobbit.name)
+    NodeId left = NIL, right = NIL;
     int height = 1;
     mutable PendingChanges pendingChanges;
-    std::string minKey, maxKey;
     void resetPendingChange() {
       pendingChanges = PendingChanges();
     }
-    Node(const Hobbit &hobbit) : hobbit(hobbit) {
-      minKey = hobbit.name;
-      maxKey = hobbit.name;
+    Node(const Hobbit &hobbit) {
+      reset(hobbit);
     }
-    const std::string& getName() const {return hobbit.name; }
+    // Reinitializes a freed node when it is handed out again.
+    void reset(const Hobbit &h) {
+      hobbit = h;
+      prefix = NameKey::prefixOf(h.name);
+      left = right = NIL;
+      height = 1;
+      resetPendingChange();
+    }
+    NameKey key() const { return {prefix, hobbit.name}; }
   };
 
-  Node *root = nullptr;
+  // An AVL tree of n nodes is less than 1.45 * log2(n + 2) levels high, so with 32-bit node
+  // ids every root-to-leaf path fits in a fixed array and no operation needs to recurse.
+  static constexpr size_t MAX_HEIGHT = 48;
+
+  struct Path {
+    std::array<NodeId, MAX_HEIGHT> ids;
+    size_t size = 0;
+
+    bool empty() const { return size == 0; }
+    void push(NodeId id) { ids[size++] = id; }
+    NodeId pop() { return ids[--size]; }
+    NodeId top() const { return empty() ? NIL : ids[size - 1]; }
+  };
+
+  std::vector<Node> nodes; // The arena, erased nodes are chained through `left` from freeNodes
+  NodeId freeNodes = NIL;
+  NodeId root = NIL;
 public:
 
+  // In-order iterator, keeping the ancestors it still has to visit on a fixed stack.
+  // Any change to the army invalidates it.
+  class Iterator {
+  public:
+    using iterator_category = std::forward_iterator_tag;
+    using value_type = Hobbit;
+    using difference_type = std::ptrdiff_t;
+    using pointer = const Hobbit*;
+    using reference = const Hobbit&;
+
+    Iterator() = default;
+
+    const Hobbit& operator*() const { return army->nodes[path.top()].hobbit; }
+    const Hobbit* operator->() const { return &**this; }
+
+    Iterator& operator++() {
+      descendLeft(army->nodes[path.pop()].right);
+      return *this;
+    }
+
+    Iterator operator++(int) {
+      Iterator old = *this;
+      ++*this;
+      return old;
+    }
+
+    friend bool operator==(const Iterator &a, const Iterator &b) { return a.path.top() == b.path.top(); }
+
+  private:
+    friend HobbitArmy;
+    const HobbitArmy *army = nullptr;
+    Path path;
+
+    Iterator(const HobbitArmy *army, NodeId root) : army(army) {
+      descendLeft(root);
+    }
+
+    // Changes are pushed down on the way, so every hobbit is up to date when it is reached.
+    void descendLeft(NodeId id) {
+      for (; id != NIL; id = army->nodes[id].left) {
+        army->pushDown(id);
+        path.push(id);
+      }
+    }
+  };
+
+  // Destroying the arena frees every node at once, no tree walk needed.
   HobbitArmy() = default;
-  ~HobbitArmy() {
-    deleteTree(root);
-  }
   HobbitArmy(const HobbitArmy&) = delete;
   HobbitArmy& operator=(const HobbitArmy&) = delete;
 
+  // Builds the army from a roster sorted by name in O(n), as a perfectly balanced tree.
+  // The result is the same as adding the hobbits one by one: those add refuses (hp <= 0,
+  // a name already taken) are left out and, with `added` set, (*added)[i] is what add
+  // would have returned for the i-th. Hobbits out of order still get in, by one add each.
+  template < std::ranges::input_range Roster >
+  explicit HobbitArmy(const Roster& sorted, std::vector<bool>* added = nullptr) {
+    if constexpr (std::ranges::sized_range<Roster>) nodes.reserve(std::ranges::size(sorted));
+    if (added) added->clear();
+
+    std::vector<Hobbit> late;
+    std::vector<size_t> lateAt;
+    for (const Hobbit& hobbit : sorted) {
+      bool ok = hobbit.hp > 0;
+      if (ok && !nodes.empty()) {
+        auto order = NameKey(hobbit.name) <=> nodes.back().key();
+        if (order < 0) {
+          late.push_back(hobbit);
+          lateAt.push_back(added ? added->size() : 0);
+        }
+        ok = order > 0;
+      }
+      if (ok) nodes.emplace_back(hobbit);
+      if (added) added->push_back(ok);
+    }
+
+    root = buildBalanced(0, NodeId(nodes.size()));
+    for (size_t i = 0; i < late.size(); i++) {
+      bool ok = add(late[i]);
+      if (added) (*added)[lateAt[i]] = ok;
+    }
+  }
+
   bool add(const Hobbit& hobbit) {
     if (hobbit.hp <= 0) return false;
-    bool flag = false;
-    root = add_impl(root, hobbit, flag);
-    return flag;
+    return add_impl(hobbit);
   }
 
   std::optional<Hobbit> erase(const std::string& hobbit_name) {
-    std::optional<Hobbit> erased = std::nullopt;
-    root = erase_impl(root, hobbit_name, erased);
-    return erased;
+    return erase_impl(NameKey(hobbit_name));
   }
 
   std::optional<Hobbit> stats(const std::string& hobbit_name) const {
-    const Node* node = find(root, hobbit_name);
-    if (node) return node->hobbit;
+    NodeId node = find(NameKey(hobbit_name));
+    if (node != NIL) return nodes[node].hobbit;
     return std::nullopt;
   }
 
@@ -110,21 +242,32 @@ public:
     if (first > last) return true;
 
     PendingChanges change = {hp_diff, off_diff, def_diff};
-    enchant_impl(root, first, last, change);
+    enchant_impl(NameKey(first), NameKey(last), change);
     return true;
   }
 
+  Iterator begin() const { return Iterator(this, root); }
+  Iterator end() const { return Iterator(); }
+
   void for_each(auto&& fun) const {
-    for_each_impl(root, fun);
+    for (const Hobbit &hobbit : *this) fun(hobbit);
   }
 
   private:
-  static void for_each_impl(Node *node, auto& fun) {
-    if (!node) return;
-    pushDown(node);
-    for_each_impl(node->left, fun);
-    fun(node->hobbit);
-    for_each_impl(node->right, fun);
+  NodeId newNode(const Hobbit &hobbit) {
+    if (freeNodes == NIL) {
+      nodes.emplace_back(hobbit);
+      return NodeId(nodes.size() - 1);
+    }
+    NodeId id = freeNodes;
+    freeNodes = nodes[id].left;
+    nodes[id].reset(hobbit);
+    return id;
+  }
+
+  void freeNode(NodeId id) {
+    nodes[id].left = freeNodes;
+    freeNodes = id;
   }
 
   static void combine(PendingChanges &target, const PendingChanges &source) {
@@ -133,191 +276,206 @@ public:
     target.hp_diff += source.hp_diff;
   }
 
-  static void apply(Node *node, PendingChanges &changes) {
-    node->hobbit.hp += changes.hp_diff;
-    node->hobbit.off += changes.off_diff;
-    node->hobbit.def += changes.def_diff;
+  static void apply(const Node &node, PendingChanges &changes) {
+    node.hobbit.hp += changes.hp_diff;
+    node.hobbit.off += changes.off_diff;
+    node.hobbit.def += changes.def_diff;
   }
 
 
-  static void pushDown(Node *node) {
-    if (!node || !hasChanges(node->pendingChanges)) {
+  void pushDown(NodeId id) const {
+    if (id == NIL || !hasChanges(nodes[id].pendingChanges)) {
       return;
     }
 
-    apply(node, node->pendingChanges);
-
-    if (node->left)
-      combine(node->left->pendingChanges, node->pendingChanges);
-    if (node->right)
-      combine(node->right->pendingChanges, node->pendingChanges);
-
-    node->resetPendingChange();
-  }
-
-  void updateMinMax(Node *n) {
-    if (!n) return;
+    const Node &node = nodes[id];
+    apply(node, node.pendingChanges);
 
-    n->minKey = n->getName();
-    n->maxKey = n->getName();
+    if (node.left != NIL)
+      combine(nodes[node.left].pendingChanges, node.pendingChanges);
+    if (node.right != NIL)
+      combine(nodes[node.right].pendingChanges, node.pendingChanges);
 
-    if (n->left)
-      n->minKey = std::min(n->minKey, n->left->minKey);
-    if (n->right)
-      n->maxKey = std::max(n->maxKey, n->right->maxKey);
+    node.pendingChanges = PendingChanges();
   }
 
   static bool hasChanges(const PendingChanges &changes) {
     return changes.hp_diff != 0 || changes.off_diff != 0 || changes.def_diff != 0;
   }
 
-  void deleteTree(Node *node) {
-    if (node) {
-      deleteTree(node->left);
-      deleteTree(node->right);
-      delete node;
-    }
-  }
-
-  int getHeight(Node *n) const {return n ? n->height : 0 ;}
-  void updateHeight(Node *n) {
-    if (n) n->height = 1 + std::max(getHeight(n->left), getHeight(n->right));
+  int getHeight(NodeId n) const {return n != NIL ? nodes[n].height : 0 ;}
+  void updateHeight(NodeId n) {
+    if (n != NIL) nodes[n].height = 1 + std::max(getHeight(nodes[n].left), getHeight(nodes[n].right));
   }
-  int getBalance(Node *n) const {
-    return n ? getHeight(n->left) - getHeight(n->right) : 0;
+  int getBalance(NodeId n) const {
+    return n != NIL ? getHeight(nodes[n].left) - getHeight(nodes[n].right) : 0;
   }
 
-  Node* rRotate(Node* y) {
+  NodeId rRotate(NodeId y) {
     pushDown(y);
-    pushDown(y->left);
-    Node* x = y->left;
-    Node *t2 = x->right;
-    x->right = y;
-    y-> left = t2;
+    pushDown(nodes[y].left);
+    NodeId x = nodes[y].left;
+    NodeId t2 = nodes[x].right;
+    nodes[x].right = y;
+    nodes[y].left = t2;
     updateHeight(y);
-    updateMinMax(y);
     updateHeight(x);
-    updateMinMax(x);
     return x;
   }
 
-  Node* lRotate(Node* x) {
+  NodeId lRotate(NodeId x) {
     pushDown(x);
-    pushDown(x->right);
-    Node* y = x->right;
-    Node *t2 = y->left;
-    y->left = x;
-    x->right = t2;
+    pushDown(nodes[x].right);
+    NodeId y = nodes[x].right;
+    NodeId t2 = nodes[y].left;
+    nodes[y].left = x;
+    nodes[x].right = t2;
     updateHeight(x);
-    updateMinMax(x);
     updateHeight(y);
-    updateMinMax(y);
     return y;
   }
 
-  Node* rebalance(Node *n) {
+  NodeId rebalance(NodeId n) {
     updateHeight(n);
-    updateMinMax(n);
 
     int balance = getBalance(n);
     if (balance > 1) {
-      if (getBalance(n->left) < 0) {
-        n->left = lRotate(n->left);
+      if (getBalance(nodes[n].left) < 0) {
+        nodes[n].left = lRotate(nodes[n].left);
       }
       return rRotate(n);
     }
     if (balance < -1) {
-      if (getBalance(n->right) > 0) {
-        n->right = rRotate(n->right);
+      if (getBalance(nodes[n].right) > 0) {
+        nodes[n].right = rRotate(nodes[n].right);
       }
       return lRotate(n);
     }
     return n;
   }
 
-  Node* findMin(Node* n) {
-    if (!n) return nullptr;
-    pushDown(n);
-    if (n->left == nullptr)
-      return n;
-    return findMin(n->left);
+  // Links the sorted nodes [lo, hi) of the arena into a perfectly balanced subtree, children
+  // before their parent, and returns its root. Recursion only goes log2(hi - lo) deep.
+  NodeId buildBalanced(NodeId lo, NodeId hi) {
+    if (lo == hi) return NIL;
+    NodeId mid = lo + (hi - lo) / 2;
+    nodes[mid].left = buildBalanced(lo, mid);
+    nodes[mid].right = buildBalanced(mid + 1, hi);
+    updateHeight(mid);
+    return mid;
   }
 
-  Node* add_impl(Node* node, const Hobbit& hobbit, bool& success) {
-    if (!node) {
-      success = true;
-      return new Node(hobbit);
-    }
-    pushDown(node);
-    if (hobbit.name < node->getName()) {
-      node->left = add_impl(node->left, hobbit, success);
-    } else if (hobbit.name > node->getName()) {
-      node->right = add_impl(node->right, hobbit, success);
-    } else {
-      success = false;
-      return node;
+  // Points whatever pointed at `from`, the child of `parent` or the root, at `to` instead.
+  void relink(NodeId parent, NodeId from, NodeId to) {
+    if (parent == NIL) root = to;
+    else if (nodes[parent].left == from) nodes[parent].left = to;
+    else nodes[parent].right = to;
+  }
+
+  // Rebalances the nodes on `path` bottom-up after the subtree below the last one changed.
+  // Once a node keeps its height without rotating, nothing above it changes either.
+  void rebalancePath(Path &path) {
+    while (!path.empty()) {
+      NodeId node = path.pop();
+      int height = nodes[node].height;
+      NodeId top = rebalance(node);
+      relink(path.top(), node, top);
+      if (top == node && nodes[node].height == height) break;
     }
-    if (!success) return node;
-    return rebalance(node);
   }
 
-  Node* erase_impl(Node* node, const std::string& name, std::optional<Hobbit>& erased) {
-    if (!node) return nullptr;
-    pushDown(node);
-    if (name < node->getName()) {
-      node->left = erase_impl(node->left, name, erased);
+  bool add_impl(const Hobbit& hobbit) {
+    NameKey key(hobbit.name);
+    Path path;
+    for (NodeId node = root; node != NIL;) {
+      pushDown(node);
+      auto order = key <=> nodes[node].key();
+      if (order == 0) return false;
+      path.push(node);
+      node = order < 0 ? nodes[node].left : nodes[node].right;
     }
-    else if (name > node->getName()) {
-      node->right = erase_impl(node->right, name, erased);
-    }  else {
-      if (!erased.has_value()) {
-        erased = node->hobbit;
-      }
-      if (!node->left) {
-        Node* temp = node->right;
-        delete node;
-        return temp;
-      } if (!node->right) {
-        Node* temp = node->left;
-        delete node;
-        return temp;
+
+    NodeId leaf = newNode(hobbit); // May grow the arena, nothing refers into it here
+    NodeId parent = path.top();
+    if (parent == NIL) root = leaf;
+    else if (key < nodes[parent].key()) nodes[parent].left = leaf;
+    else nodes[parent].right = leaf;
+    rebalancePath(path);
+    return true;
+  }
+
+  std::optional<Hobbit> erase_impl(const NameKey& name) {
+    Path path;
+    NodeId node = find(name, &path);
+    if (node == NIL) return std::nullopt;
+    std::optional<Hobbit> erased = std::move(nodes[node].hobbit);
+
+    // With two children the node takes over its successor's hobbit and the successor,
+    // which has no left child, is unlinked instead.
+    if (nodes[node].left != NIL && nodes[node].right != NIL) {
+      path.push(node);
+      NodeId successor = nodes[node].right;
+      pushDown(successor);
+      while (nodes[successor].left != NIL) {
+        path.push(successor);
+        successor = nodes[successor].left;
+        pushDown(successor);
       }
-      Node* successor = findMin(node->right);
-      node->hobbit = successor->hobbit;
-      std::optional<Hobbit> dummy;
-      node->right = erase_impl(node->right, successor->getName(), dummy);
+      nodes[node].hobbit = std::move(nodes[successor].hobbit);
+      nodes[node].prefix = nodes[successor].prefix;
+      node = successor;
     }
-    return rebalance(node);
-  }
 
-  const Node* find(Node *node, const std::string &name) const {
-    if (!node) return nullptr;
-    pushDown(node);
-    if (name < node->getName())
-      return find(node->left, name);
-    if (name > node->getName())
-      return find(node->right, name);
-    return node;
+    relink(path.top(), node, nodes[node].left != NIL ? nodes[node].left : nodes[node].right);
+    freeNode(node);
+    rebalancePath(path);
+    return erased;
   }
 
-  void enchant_impl(Node* node, const std::string& first, const std::string& last, const PendingChanges &changes) {
-    if (!node) return;
-    pushDown(node);
-    if (node->maxKey < first || node->minKey > last)
-      return;
-
-    if (node->minKey >= first && node->maxKey <= last) {
-      combine(node->pendingChanges, changes);
-      return;
+  // With `path`, the ancestors of the node found are left on it.
+  NodeId find(const NameKey &name, Path *path = nullptr) const {
+    for (NodeId node = root; node != NIL;) {
+      pushDown(node);
+      auto order = name <=> nodes[node].key();
+      if (order == 0) return node;
+      if (path) path->push(node);
+      node = order < 0 ? nodes[node].left : nodes[node].right;
     }
-    const std::string& name = node->getName();
-    if (name >= first && name <= last) {
-      node->hobbit.hp += changes.hp_diff;
-      node->hobbit.off += changes.off_diff;
-      node->hobbit.def += changes.def_diff;
+    return NIL;
+  }
+
+  // Every name below a node lies strictly between the names of `lo` and `hi` (NIL when
+  // unbounded), the ancestors passed on the way down. Once both bounds are inside the range
+  // the whole subtree is, and it gets the change lazily. Only the two paths to the ends of
+  // the range go deeper, children outside of it are never entered. The stack holds at most
+  // one postponed right child per level.
+  void enchant_impl(const NameKey& first, const NameKey& last, const PendingChanges &changes) {
+    struct Bounded {
+      NodeId id, lo, hi;
+    };
+    std::array<Bounded, MAX_HEIGHT + 1> stack;
+    size_t depth = 0;
+    if (root != NIL) stack[depth++] = {root, NIL, NIL};
+
+    while (depth > 0) {
+      auto [id, lo, hi] = stack[--depth];
+      pushDown(id);
+      Node &node = nodes[id];
+      if (lo != NIL && hi != NIL && nodes[lo].key() >= first && nodes[hi].key() <= last) {
+        combine(node.pendingChanges, changes);
+        continue;
+      }
+      NameKey name = node.key();
+      if (name >= first && name <= last) {
+        node.hobbit.hp += changes.hp_diff;
+        node.hobbit.off += changes.off_diff;
+        node.hobbit.def += changes.def_diff;
+      }
+      if (last > name && node.right != NIL)
+        stack[depth++] = {node.right, id, hi};
+      if (first < name && node.left != NIL)
+        stack[depth++] = {node.left, lo, id};
     }
-    enchant_impl(node->left, first, last, changes);
-    enchant_impl(node->right, first, last, changes);
   }
 };
 
@@ -408,9 +566,137 @@ void test1(int& ok, int& fail) {
   }, ok, fail);
 }
 
+// Random adds, erases and enchants against a std::map, so erased nodes get reused.
+void test2(int& ok, int& fail) {
+  HobbitArmy A;
+  std::map<std::string, Hobbit> ref;
+  std::mt19937 rng(12);
+  auto name = [&] { return "Hobbit " + std::to_string(rng() % 150); };
+
+  for (int step = 1; step <= 3000; step++) {
+    int op = rng() % 10;
+    if (op < 5) {
+      Hobbit h = {name(), int(rng() % 100) - 10, int(rng() % 20), int(rng() % 20)};
+      bool added = h.hp > 0 && !ref.contains(h.name);
+      if (added) ref[h.name] = h;
+      CHECK(A.add(h), added);
+    } else if (op < 8) {
+      std::string n = name();
+      auto it = ref.find(n);
+      std::optional<Hobbit> erased;
+      if (it != ref.end()) {
+        erased = it->second;
+        ref.erase(it);
+      }
+      CHECK(A.erase(n), erased);
+    } else {
+      std::string first = name(), last = name();
+      int hp = int(rng() % 7) - 3, off = int(rng() % 7) - 3, def = int(rng() % 7) - 3;
+      for (auto it = ref.lower_bound(first); first <= last && it != ref.end() && it->first <= last; ++it) {
+        it->second.hp += hp;
+        it->second.off += off;
+        it->second.def += def;
+      }
+      CHECK(A.enchant(first, last, hp, off, def), true);
+    }
+
+    if (step % 250 == 0) {
+      std::vector<Hobbit> expected;
+      for (auto &[n, h] : ref) expected.push_back(h);
+      check_army(A, expected, ok, fail);
+      std::string probe = name();
+      CHECK(A.stats(probe), ref.contains(probe) ? std::optional(ref[probe]) : std::nullopt);
+    }
+  }
+}
+
+// Names around the 8 bytes compared as an integer: NULs, bytes above 127 and shared prefixes
+// must come out in std::string order.
+void test3(int& ok, int& fail) {
+  HobbitArmy A;
+  std::map<std::string, Hobbit> ref;
+  std::mt19937 rng(3);
+  const std::string alphabet("\0a\x7f\x80\xff", 5);
+
+  for (int i = 0; i < 2000; i++) {
+    std::string name(rng() % 12, 'a');
+    for (auto &c : name) c = alphabet[rng() % alphabet.size()];
+    Hobbit h = {name, 1 + int(rng() % 50), i, 0};
+    bool added = ref.try_emplace(name, h).second;
+    CHECK(A.add(h), added);
+  }
+
+  std::vector<Hobbit> expected;
+  for (auto &[n, h] : ref) expected.push_back(h);
+  check_army(A, expected, ok, fail);
+  for (auto &[n, h] : ref) {
+    if (rng() % 10 == 0) CHECK(A.stats(n), std::optional(h));
+  }
+}
+
+// The iterator sees pending enchants, works with the ranges algorithms and can stop early.
+void test4(int& ok, int& fail) {
+  static_assert(std::forward_iterator<HobbitArmy::Iterator>);
+  HobbitArmy A;
+  CHECK(A.begin() == A.end(), true);
+
+  constexpr int N = 100'000;
+  auto name = [](int i) {
+    std::string digits = std::to_string(i);
+    return std::string(6 - digits.size(), '0') + digits;
+  };
+  for (int i = 0; i < N; i++) A.add({name(i), 10, i, 0}); // Sorted, the worst case for rebalancing
+  for (int i = 0; i < N; i += 3) A.erase(name(i));
+  A.enchant(name(500), name(N / 2), 0, 0, 7);
+
+  std::vector<Hobbit> iterated(A.begin(), A.end()), visited;
+  A.for_each([&](const Hobbit& h) { visited.push_back(h); });
+  CHECK(iterated.size(), size_t(N - (N + 2) / 3));
+  CHECK(iterated == visited, true);
+
+  auto enchanted = std::ranges::find_if(A, [](const Hobbit& h) { return h.def != 0; });
+  CHECK(enchanted != A.end(), true);
+  CHECK(*enchanted, Hobbit(name(500), 10, 500, 7));
+  CHECK((++enchanted)->name, name(502));
+}
+
+// A sorted roster with the mistakes add refuses, and a few hobbits out of order, gives the
+// same army and the same answers as adding them one by one.
+void test5(int& ok, int& fail) {
+  std::mt19937 rng(5);
+  std::vector<Hobbit> roster;
+  for (int i = 0; i < 20'000; i++) {
+    std::string name = "Hobbit " + std::to_string(100'000 + i);
+    roster.push_back({name, int(rng() % 100) - 5, i, 0});
+    if (rng() % 50 == 0) roster.push_back({name, 40, -i, 0}); // Duplicate
+  }
+  for (int i = 0; i < 30; i++) roster.push_back({"Hobbit " + std::to_string(rng() % 130'000), 9, -1, -1});
+
+  std::vector<bool> added;
+  HobbitArmy bulk(roster, &added);
+  HobbitArmy one;
+  std::vector<bool> expected;
+  for (auto& h : roster) expected.push_back(one.add(h));
+  CHECK(added == expected, true);
+  CHECK(std::ranges::equal(bulk, one), true);
+
+  bulk.enchant("Hobbit 105", "Hobbit 11", 1, 2, 3);
+  one.enchant("Hobbit 105", "Hobbit 11", 1, 2, 3);
+  CHECK(bulk.erase("Hobbit 107777"), one.erase("Hobbit 107777"));
+  CHECK(bulk.add({"Hobbit 107777", 5, 5, 5}), one.add({"Hobbit 107777", 5, 5, 5}));
+  CHECK(std::ranges::equal(bulk, one), true);
+
+  HobbitArmy empty(std::vector<Hobbit>{});
+  CHECK(empty.begin() == empty.end(), true);
+}
+
 int main() {
   int ok = 0, fail = 0;
   test1(ok, fail);
+  test2(ok, fail);
+  test3(ok, fail);
+  test4(ok, fail);
+  test5(ok, fail);
 
   if (!fail) std::cout << "Passed all " << ok << " tests!" << std::endl;
   else std::cout << "Failed " << fail << " of " << (ok + fail) << " tests." << std::endl;